@@ -0,0 +1,55 @@
+// the queue of aural notices waiting to be played by aural_notifier().
+// aural_notifier() runs in its own task and hands each message to http_sound(), file_sound(), and tell().
+// main.cpp implements those with ESP8266Audio and I2S, [env:native] uses the stand-ins in src/native/audio_player.cpp
+//
+// messages are sent to qaudio_messages with queue_audio_message(). aural_notifier() moves them into its own list ordered by
+// priority, then by when they were queued, so an urgent notice does not wait behind a long TTS readout.
+// play() calls is_audio_preempted() between mp3 frames, and a message with a higher priority than the one playing cuts in.
+// the message that was cut off is played again from the start afterwards.
+
+#ifndef AUDIO_QUEUE_H
+#define AUDIO_QUEUE_H
+
+#include <Arduino.h>
+
+#include "config.h"
+
+#define AUDIO_QUEUE_LENGTH 25 // messages qaudio_messages and the priority ordered list can each hold
+
+struct AudioMessage {
+  uint32_t id;
+  char description[DESCRIPTION_SIZE];
+  char sound[SOUND_SIZE];
+  char voice[VOICE_SIZE];
+  time_t timestamp;
+  bool do_long_notify;
+  uint8_t priority; // 0 to PRIORITY_MAX
+  uint32_t queued_ms; // millis() when queue_audio_message() was called, for audio_queue_stats.wait_ms
+};
+
+// counters for /audio_stats.json. queued and dropped_sending are only written by queue_audio_message() on loop()'s task,
+// the rest only by aural_notifier()'s task, so no counter is written by both and no increment is lost.
+struct AudioQueueStats {
+  uint32_t queued; // messages accepted by queue_audio_message()
+  uint32_t played;
+  uint32_t preempted; // messages cut off by a higher priority one
+  uint32_t dropped_sending; // messages lost because qaudio_messages was full
+  uint32_t dropped_pending; // messages lost because the priority ordered list was full
+  uint16_t depth; // messages waiting in the priority ordered list now. /audio_stats.json adds the ones still in qaudio_messages.
+  uint16_t max_depth;
+  uint32_t wait_ms_max; // longest time between queue_audio_message() and the message starting to play
+  uint32_t wait_ms_total; // a preempted message waits again, so divide by played + preempted for the mean
+};
+
+extern QueueHandle_t qaudio_messages;
+extern bool is_audio_message_queued;
+extern struct AudioQueueStats audio_queue_stats;
+
+bool queue_audio_message(struct AudioMessage& am);
+bool is_audio_preempted(void);
+void http_sound(const char* url);
+void tell(const char* description, const char* voice, time_t timestamp, bool do_long_notify);
+void file_sound(const char* filename);
+void aural_notifier(void* parameter);
+
+#endif
@@ -0,0 +1,61 @@
+// settings shared by main.cpp and the scheduler, storage, renderer, and audio queue code.
+// [env:native] builds everything except main.cpp, so nothing here may depend on WiFi or the web server.
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// storage locations for animated matrices and playlists.
+// note the pathes are hardcoded in the HTML files, so changing these defines is not enough.
+// do not put a / at the end
+#define FILE_ROOT "/files"
+#define SND_ROOT FILE_ROOT "/snd"
+#define USR_ROOT FILE_ROOT "/usr"
+
+#define EVENT_CHECK_INTERVAL 5000 // milliseconds. how frequently checks for events happening now should occur.
+
+// what check_for_recent_events() does with an occurrence it finds more than 30 seconds late,
+// e.g. one that came due while the device was restarting or before the clock was stepped forward.
+#define MISSED_EVENTS_SKIP 0 // drop it
+#define MISSED_EVENTS_SHOW 1 // only give the visual notice
+#define MISSED_EVENTS_NOTIFY 2 // give the visual and aural notices, the description is followed by when it occurred
+#if !defined MISSED_EVENTS_POLICY
+#define MISSED_EVENTS_POLICY MISSED_EVENTS_NOTIFY
+#endif
+#define MISSED_EVENTS_MAX_AGE (24*60*60) // seconds. occurrences older than this are dropped whatever the policy.
+
+#define DESCRIPTION_SIZE 301 // frontend allows up to 100 but with percent encoding the description could become much longer.
+#define SOUND_SIZE 101
+#define VOICE_SIZE 15 // longest voice string for voicerss: fr-ca&v=Olivia
+#define PRIORITY_MAX 3 // event priorities go from 0, the default, to this. a higher priority aural notice cuts in on a lower one.
+#define EVENT_JSON_SIZE 2048 // ArduinoJson capacity for one event while events.json is streamed in
+
+#define RANDOM_SOUND_MARKER "?????"
+#define HTTP_SOUND_PREFIX "http://"
+
+#undef DEBUG_CONSOLE
+#if !defined DISABLE_DEBUG_CONSOLE // [env:native] sets this so debugging output does not skew benchmarks
+#define DEBUG_CONSOLE Serial
+#endif
+#if defined DEBUG_CONSOLE && !defined DEBUG_PRINTLN
+  #define DEBUG_BEGIN(x)     DEBUG_CONSOLE.begin (x)
+  #define DEBUG_PRINT(x)     DEBUG_CONSOLE.print (x)
+  #define DEBUG_PRINTDEC(x)     DEBUG_PRINT (x, DEC)
+  #define DEBUG_PRINTLN(x)  DEBUG_CONSOLE.println (x)
+  #define DEBUG_PRINTF(...) DEBUG_CONSOLE.printf(__VA_ARGS__)
+  #define DEBUG_FLUSH()     DEBUG_CONSOLE.flush ()
+#else
+  #define DEBUG_BEGIN(x)
+  #define DEBUG_PRINT(x)
+  #define DEBUG_PRINTDEC(x)
+  #define DEBUG_PRINTLN(x)
+  #define DEBUG_PRINTF(...)
+  #define DEBUG_FLUSH()
+#endif
+
+// set by main.cpp on hardware and by the native driver on a host
+extern bool restart_needed;
+
+// wakes loop() when it is idle and waiting for the next event. main.cpp implements it, the native driver never waits.
+void wake_loop(void);
+
+#endif
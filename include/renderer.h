@@ -0,0 +1,191 @@
+// drawing the visual notices on the LED ring.
+//
+// loop() owns the events, so it works out which notices to show and post_visual_notices() posts them to a mailbox.
+// visual_notifier() runs in its own task, picks up the latest notices, draws and composites them, and hands each frame to
+// led_output(), another task that sends it to the strip while the next frame is drawn. a slow pass of loop(), e.g. parsing
+// events.json or the web server, does not hold up the animation, and the render task never waits on the strip.
+
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <vector>
+
+#include "config.h"
+
+#define DATA_PIN 16
+#define COLOR_ORDER GRB
+#define LED_STRIP_VOLTAGE 5
+#define LED_STRIP_MILLIAMPS 270
+#define HOMOGENIZE_BRIGHTNESS true
+// show() hands led_output() at most this many frames a second and only when something was drawn since the last one.
+// breathing() changes the brightness every 10 ms, nothing else changes faster.
+#define RENDER_FPS 100
+#define RENDER_FRAME_INTERVAL (1000/RENDER_FPS) // milliseconds
+#define COMPILED_FRAMES_MAX 8 // first frames of notices kept by fill_compiled(), each is NUM_LEDS*3 bytes
+// visual_notifier() shows up to this many notices at once, each in its own segment of the ring. each one costs NUM_LEDS*3 bytes.
+// a small ring shows fewer at once so every segment has at least NOTICE_SEGMENT_MIN_LEDS LEDs to show its pattern on.
+#define NOTICE_LAYERS_MAX 8
+#define NOTICE_SEGMENT_MIN_LEDS 8
+#define NOTICE_SHOW_TIME 4000 // milliseconds. when more notices are waiting than can be shown at once they take turns this long.
+// ticks an AnimationTimer makes up at once after the render task was held up. after a longer stall the animation carries on from where it was.
+#define ANIMATION_CATCH_UP_MAX 50
+// both tasks run on the core loop() uses, core 0 has WiFi, aural_notifier(), and events_loader().
+// a higher priority than loop() lets a frame in whenever it comes due. led_output() sleeps while the strip is written.
+#define RENDER_TASK_CORE 1
+#define RENDER_TASK_PRIORITY 2
+#define LED_OUTPUT_PRIORITY 3
+
+// every pattern, in the order the frontend lists them. adding a pattern is one line here and its draw function in renderer.cpp.
+// the value is what events.json stores in "p", so changing it changes the pattern existing events show.
+// values can be 0 to 254, 255 indicates a pattern be randomly chosen by the backend.
+// NO_PATTERN is not listed since it does not make sense to present it as an option in the frontend.
+#define PATTERN_LIST(X) \
+  X(SOLID,   0, "Solid",   draw_solid) \
+  X(BREATHE, 1, "Breathe", draw_breathe) \
+  X(BLINK,   2, "Blink",   draw_blink) \
+  X(SPIN,    3, "Spin",    draw_spin) \
+  X(TWINKLE, 4, "Twinkle", draw_twinkle)
+
+#define RANDOM_PATTERN 255
+
+#define PATTERN_ENUM(name, value, label, draw) name = value,
+enum Pattern {
+  PATTERN_LIST(PATTERN_ENUM)
+};
+
+struct NoticeLayer;
+
+// draws a pattern into layer on one pass of visual_notifier(). layer.refill is true on the first pass for a notice.
+typedef void (*PatternDraw)(struct NoticeLayer& layer);
+
+struct PatternDescriptor {
+  uint8_t value;
+  const char* name;
+  PatternDraw draw;
+};
+
+// every special color, in the order the frontend lists them, the same as PATTERN_LIST. the value is what events.json stores in "c".
+// the 0x01 in the upper byte indicates a special color, write the value as 0x01 and six lowercase hex digits since it is also the JSON.
+// fill() paints the first color on the first half of the ring and the second color on the other half.
+// RAINBOW is the exception, its colors are not used.
+#define SPECIAL_COLOR_LIST(X) \
+  X(RAINBOW,       0x01000000, "Rainbow",           CRGB::Black,  CRGB::Black) \
+  X(RED_GREEN,     0x01000001, "Red and Green",     CRGB::Red,    CRGB::Green) \
+  X(ORANGE_BLUE,   0x01000002, "Orange and Blue",   CRGB::Orange, CRGB::Blue) \
+  X(YELLOW_PURPLE, 0x01000003, "Yellow and Purple", CRGB::Yellow, CRGB::Purple)
+
+#define SPECIAL_COLOR_ENUM(name, value, label, first, second) name = value,
+enum SpecialColor {
+  SPECIAL_COLOR_LIST(SPECIAL_COLOR_ENUM)
+};
+
+struct SpecialColorDescriptor {
+  uint32_t value;
+  const char* name;
+  uint32_t first_half; // 0xRRGGBB
+  uint32_t second_half;
+};
+
+// every layer animates against the same time, read once per pass of the render task. the timers checked on a pass leave
+// the soonest deadline in next_due_ms, so the task knows how long it can sleep before anything needs drawing.
+struct AnimationClock {
+  uint32_t now;
+  uint32_t next_due_ms;
+  bool is_due_set; // false if no timer was checked on the last pass, e.g. only SOLID notices are showing
+};
+
+// comes due every interval milliseconds of the animation clock. the deadlines do not drift with how late the task gets to the timer,
+// and the ticks that came due while the task was held up are handed out together so the animation keeps its speed.
+// every layer and overlay has its own, so timers with different intervals no longer reset each other.
+struct AnimationTimer {
+  uint32_t due_ms;
+  bool is_running; // false until the first timer_ticks(), which starts it one interval from then
+};
+
+// a notice being shown. its pattern draws the whole ring into pixels as if it were the only notice, in the same order as leds,
+// and the compositor fits that into the notice's segment of the ring.
+struct NoticeLayer {
+  uint16_t id; // event.id of the notice
+  const struct PatternDescriptor* pattern; // nullptr if the event's pattern is unknown, the segment stays dark
+  uint32_t color; // a random color has already been picked
+  CRGB* pixels;
+  uint32_t power_mW; // calculate_unscaled_power_mW() of pixels if is_power_known
+  bool is_power_known;
+  uint8_t brightness; // what FastLED's brightness would be set to if this were the only notice
+  uint16_t phase; // spin() rotates the layer without moving pixels, position i shows pixels[(i + phase) % NUM_LEDS]
+  uint8_t step; // of breathing() and blink()
+  struct AnimationTimer timer; // the pattern's
+  bool refill;
+  bool changed; // pixels, phase, or brightness changed since the layer was last composited
+  bool repainted; // pixels changed
+};
+
+extern uint16_t LEDS_ORIGIN_OFFSET;
+extern uint16_t NUM_LEDS;
+extern CRGB* leds;
+extern uint8_t homogenized_brightness;
+
+extern const struct PatternDescriptor pattern_registry[];
+extern const uint8_t num_patterns;
+extern const char patterns_json[];
+extern const struct SpecialColorDescriptor special_color_registry[];
+extern const uint8_t num_special_colors;
+extern const char special_colors_json[];
+
+// counters for /render_stats.json
+struct RenderStats {
+  uint32_t frames; // frames sent to the LEDs
+  uint32_t skipped; // frames not sent because nothing changed
+  uint32_t dropped; // frame slots that went by before a changed frame was sent
+  uint32_t frame_ms; // time between the last two frames sent
+  uint32_t late_ms_max; // longest a changed frame waited past its frame slot, the jitter of the animation
+  uint32_t output_busy; // times a frame was held back because led_output() was still sending the one before
+  uint32_t render_us; // the last pass of visual_notifier(), drawing and compositing without sending
+  uint32_t render_us_max;
+  uint32_t show_us; // time the last FastLED.show() took on led_output()'s task
+  uint32_t show_us_max;
+  uint32_t ticks_caught_up; // animation timer ticks that came due while the render task was busy and were made up on a later pass
+  uint32_t ticks_lost; // ticks beyond ANIMATION_CATCH_UP_MAX that were never made up
+};
+
+extern struct RenderStats render_stats;
+extern struct AnimationClock animation_clock;
+
+void renderer_setup(void);
+void timer_reset(struct AnimationTimer& timer);
+uint16_t timer_ticks(struct AnimationTimer& timer, uint16_t interval);
+uint8_t max_brightness_for_power(uint8_t target_brightness);
+void homogenize_brightness(void);
+void set_brightness(uint8_t brightness);
+uint32_t ms_until_next_frame(void);
+uint32_t ms_until_next_redraw(void);
+void show(void);
+uint16_t idx(uint16_t index_in);
+
+void breathing(struct NoticeLayer& layer, uint16_t draw_interval);
+void blink(struct NoticeLayer& layer, uint16_t draw_interval, uint8_t num_blinks, uint8_t num_intervals_off);
+//uint16_t forwards(uint16_t index_in);
+uint16_t backwards(uint16_t index_in);
+void spin(struct NoticeLayer& layer, uint16_t draw_interval, uint16_t(*dfp)(uint16_t));
+void twinkle(CRGB* pixels);
+void fill_gradient_RGB_circular(CRGB* leds, CRGB start_color, CRGB end_color);
+const struct SpecialColorDescriptor* find_special_color(uint32_t value);
+void fill_ring(CRGB* pixels, uint16_t from, uint16_t to, const CRGB& color);
+void fill(CRGB* pixels, uint32_t color);
+uint32_t fill_compiled(CRGB* pixels, uint32_t color);
+void draw_solid(struct NoticeLayer& layer);
+void draw_breathe(struct NoticeLayer& layer);
+void draw_blink(struct NoticeLayer& layer);
+void draw_spin(struct NoticeLayer& layer);
+void draw_twinkle(struct NoticeLayer& layer);
+const struct PatternDescriptor* find_pattern(uint8_t value);
+void post_visual_notices(void);
+uint32_t ms_until_next_turn(void);
+uint32_t render_notices(void);
+void visual_notifier(void* parameter);
+void led_output(void* parameter);
+
+
+#endif
@@ -0,0 +1,137 @@
+// events, their recurrence rules, and the schedule that decides when each event happens.
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <time.h>
+#include <atomic>
+#include <vector>
+
+#include "config.h"
+
+#define NO_OCCURRENCE INT32_MAX
+#define MAX_MONTHS_SEARCHED 100
+#define TZ_TABLE_YEARS 10 // years after this one covered by tz_table_rebuild()
+#define NEW_EVENT_ID UINT16_MAX // passed to queue_event_change() to add an event. new_id() never hands it out.
+#define UPCOMING_MAX 100 // most occurrences /upcoming.json lists at once
+
+struct Recurrence {
+  int32_t start_day; // local date of the start date as days since 1970-01-01
+  int32_t time_of_day; // local time of the start time as seconds since midnight
+  int32_t end_day; // local date of the end date as days since 1970-01-01 or NO_OCCURRENCE if the event never ends
+  int32_t end_time_of_day; // local time of the end time as seconds since midnight
+  char frequency; // o == Once, d == Daily, w == weekly, m == Monthly, y == Yearly
+  uint16_t interval; // every interval days, weeks, months, or years
+  uint8_t by_day; // weekday mask, same bits as exclude
+  uint8_t exclude; // weekdays to skip. occurrences on these days are never scheduled.
+  int8_t nth; // monthly and yearly only. 0 is the start date's day of the month, 1 to 5 is the nth by_day weekday, -1 is the last by_day weekday
+};
+
+// the strings are kept out of the Event so the events table stays small. see event_strings below.
+struct Event {
+  time_t next_fire; // seconds since the Unix Epoch of the next occurrence. only changed while the event is out of the schedule.
+  time_t timestamp;
+  struct Recurrence rule;
+  uint32_t color;
+  uint32_t description; // offset in event_strings
+  uint16_t id;
+  uint16_t sound; // index in interned_strings
+  uint16_t voice; // index in interned_strings
+  uint8_t pattern;
+  uint8_t priority : 7; // 0 to PRIORITY_MAX. bit fields so the priority fits in the byte is_random_sound already used.
+  bool is_random_sound : 1;
+};
+static_assert(sizeof(Event) < 64, "keep Event small, every loaded event has one");
+
+struct Occurrence {
+  time_t at;
+  uint16_t id;
+};
+
+// everything loaded from the events files. the live table is event_table and the globals below refer to its members.
+// load_events_file() builds a new table off to the side and swap_event_table() swaps it in, so readers never see a half built table.
+// positions and indices let put_event() and remove_event() find an event and move it in the schedule without walking either.
+// both are rebuilt by schedule_rebuild(), so code that adds or erases events directly must call it afterwards.
+#define NO_INDEX UINT16_MAX
+
+struct EventTable {
+  std::vector<Event> events;
+  std::vector<uint16_t> schedule;
+  std::vector<uint16_t> positions; // position in schedule of each event, NO_INDEX if it is not scheduled
+  std::vector<uint16_t> indices; // index in events of each id, NO_INDEX if there is no event with that id
+  std::vector<char> strings = std::vector<char>(1, '\0');
+  std::vector<uint32_t> interned = std::vector<uint32_t>(1, 0);
+  std::atomic<uint16_t> next_id{0}; // new_id() is called by the web server while loop() reserves ids, so it is only changed atomically
+};
+
+extern EventTable event_table;
+extern std::vector<Event>& events;
+
+// the scheduler reads the time through scheduler_clock instead of calling time() directly so [env:native] can replay
+// schedules on a simulated clock. it defaults to time() and has the same signature.
+extern time_t (*scheduler_clock)(time_t* t);
+
+// the schedule is a binary min-heap of indices into events ordered by each event's next_fire.
+// check_for_recent_events() only has to look at the top of the heap to know if anything is due,
+// so the cost of a check depends on the number of events that are due rather than the total number of events.
+extern std::vector<uint16_t>& schedule;
+
+// the strings of every event live in one arena, each NUL terminated. offset 0 is the empty string.
+// descriptions are appended as they are. sounds and voices repeat, so each one is stored once and listed in interned_strings.
+// strings of replaced and deleted events stay in the arena until the events are reloaded, which compacting the journal also does.
+extern std::vector<char>& event_strings;
+extern std::vector<uint32_t>& interned_strings;
+
+// every occurrence at or before the watermark has been handled by check_for_recent_events(). it is kept in NVS,
+// so the occurrences that came due while the device was off or restarting can be caught up at boot.
+extern time_t scheduler_watermark;
+
+// changes whenever an event's notice is set or cleared, or events are added, replaced, or removed in the live table.
+// the renderer only rebuilds its list of active notices when this is different from the last time it looked.
+extern uint32_t notices_version;
+
+void fill_in_datetime(tm* datetime);
+tm new_time(uint32_t value, char unit);
+int32_t days_from_civil(int32_t y, uint8_t m, uint8_t d);
+void civil_from_days(int32_t z, int32_t* y, uint8_t* m, uint8_t* d);
+uint8_t weekday_from_days(int32_t z);
+uint8_t days_in_month(int32_t y, uint8_t m);
+int32_t occurrence_in_month(const Recurrence& rule, uint8_t start_mday, int32_t y, uint8_t m, int32_t from_day);
+int32_t next_occurrence_day(const Recurrence& rule, int32_t from_day);
+void tz_table_rebuild(time_t around);
+time_t local_seconds_to_epoch(int64_t local);
+void epoch_to_local(time_t t, int32_t* day, int32_t* time_of_day);
+void epoch_to_tm(time_t t, tm* datetime);
+time_t local_to_epoch(int32_t day, int32_t time_of_day);
+time_t next_fire_after(const Recurrence& rule, time_t after);
+time_t refresh_datetime(const Recurrence& rule);
+void reschedule(Event& event);
+time_t catch_up_from(void);
+void load_scheduler_watermark(void);
+bool is_expired(time_t next_fire, const Recurrence& rule);
+uint16_t new_id(bool reset);
+void reserve_id(uint16_t id, EventTable& table = event_table);
+void scheduler_setup(void);
+bool is_event_id_known(uint16_t id);
+void set_event_id_known(uint16_t id, bool is_known);
+int32_t event_index(uint16_t id, const EventTable& table = event_table);
+void put_event(const Event& event, EventTable& table = event_table);
+bool remove_event(uint16_t id, EventTable& table = event_table);
+void schedule_push(uint16_t index, EventTable& table = event_table);
+void schedule_remove(uint16_t index, EventTable& table = event_table);
+void schedule_rebuild(EventTable& table = event_table);
+void swap_event_table(EventTable& table);
+time_t next_scheduled_fire(void);
+void check_for_recent_events(uint16_t interval);
+uint16_t upcoming_occurrences(Occurrence* out, uint16_t n);
+void refresh_upcoming(void);
+uint16_t copy_upcoming(Occurrence* out, uint16_t n);
+void clear_event_strings(void);
+uint32_t add_event_string(const char* s, size_t size, EventTable& table = event_table);
+uint16_t intern_event_string(const char* s, size_t size, EventTable& table = event_table);
+const char* event_description(const Event& event, const EventTable& table = event_table);
+const char* event_sound(const Event& event, const EventTable& table = event_table);
+const char* event_voice(const Event& event, const EventTable& table = event_table);
+
+#endif
@@ -0,0 +1,77 @@
+// reading and writing the events and file list JSON kept in LittleFS.
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "scheduler.h"
+
+// the events table parsed from events.json is also saved as a binary snapshot so it can be loaded at boot without parsing JSON.
+// events.json is still what the frontend reads and writes. the snapshot is deleted whenever events.json is saved and rewritten by
+// the next load_events_file(). it is laid out as a header, num_records fixed-size records, then a blob of NUL terminated strings.
+// the blob is a copy of event_strings, so loading the snapshot does not have to copy the strings one at a time.
+#define EVENTS_SNAPSHOT_PATH USR_ROOT "/events.bin"
+#define EVENTS_SNAPSHOT_MAGIC 0x45424E53 // "SNBE" in a little endian file
+#define EVENTS_SNAPSHOT_VERSION 5 // increase when EventsSnapshotHeader, EventRecord, or Recurrence change
+
+// adding, changing, or deleting one event through the /event endpoints appends a line to the journal instead of rewriting events.json.
+// each line is an event object with its "id", or {"id":N,"x":1} when the event was deleted. the last line for an id wins.
+// load_events_file() replays the journal on top of events.json or the snapshot. compact_events_file() folds it back into
+// events.json on events_loader()'s task once it is bigger than EVENTS_JOURNAL_MAX_SIZE. the frontend reads it along with events.json.
+#define EVENTS_JOURNAL_PATH USR_ROOT "/events.log"
+#define EVENTS_JOURNAL_MAX_SIZE 8192
+#define EVENT_CHANGES_QUEUE_LENGTH 8
+
+struct EventsSnapshotHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size; // sizeof(EventRecord) when the snapshot was written
+  uint32_t json_crc; // CRC-32 of the events.json the snapshot was made from. a different CRC means events.json changed.
+  uint32_t num_records;
+  uint32_t blob_size;
+  uint32_t next_id; // new_id() when the snapshot was written. events.json can hold ids of expired events that are not in the snapshot.
+};
+
+// a table being built by events_loader(). sent to it on qevent_reloads and back to loop() on qevent_tables.
+struct EventsReload {
+  EventTable* table;
+  time_t after; // events are scheduled from their first occurrence after this
+  bool compact; // fold the journal into events.json with compact_events_file() before the table is built
+  bool compact_failed;
+  bool failed;
+};
+
+struct EventRecord {
+  struct Recurrence rule;
+  uint16_t id;
+  uint8_t pattern;
+  bool is_random_sound;
+  uint8_t priority;
+  uint32_t color;
+  uint32_t description; // offsets of the strings in the blob
+  uint32_t sound;
+  uint32_t voice;
+};
+
+extern const char* stored_file_list;
+extern bool events_reload_needed;
+extern QueueHandle_t qevent_changes;
+extern QueueHandle_t qevent_reloads;
+extern QueueHandle_t qevent_tables;
+
+void set_random_sound(char* sound, size_t sound_len);
+bool events_json_crc(uint32_t* crc);
+bool load_events_snapshot(EventTable& table, time_t after, uint32_t json_crc);
+bool save_events_snapshot(uint32_t json_crc, const EventTable& table);
+bool load_events_file(void);
+void events_loader(void* parameter);
+bool start_events_reload(bool compact = false);
+bool finish_events_reload(void);
+bool queue_event_change(uint16_t* id, const String& json, String& message);
+void apply_event_changes(void);
+bool compact_events_file(void);
+bool save_file(String fs_path, String json, String& message);
+
+#endif
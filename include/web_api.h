@@ -0,0 +1,11 @@
+// web endpoints for events, patterns, and special colors.
+// kept apart from the WiFi and captive portal setup in main.cpp so [env:native] can exercise them.
+
+#ifndef WEB_API_H
+#define WEB_API_H
+
+#include <ESPAsyncWebServer.h>
+
+void web_api_setup(AsyncWebServer& server);
+
+#endif
@@ -0,0 +1,132 @@
+#include "audio_queue.h"
+
+QueueHandle_t qaudio_messages = xQueueCreate(AUDIO_QUEUE_LENGTH, sizeof(struct AudioMessage));
+bool is_audio_message_queued = false;
+struct AudioQueueStats audio_queue_stats = {0};
+
+// everything below except audio_queue_stats is only used by aural_notifier()'s task. play() runs in that task too.
+static struct AudioMessage pending[AUDIO_QUEUE_LENGTH]; // highest priority first, oldest first within a priority
+static uint16_t num_pending = 0;
+static int16_t playing_priority = -1; // priority of the message being played, -1 if nothing is
+static bool preempted = false;
+
+
+// called by the scheduler and the button handlers instead of sending to qaudio_messages directly, so drops are counted.
+bool queue_audio_message(struct AudioMessage& am) {
+  am.queued_ms = millis();
+  if (xQueueSend(qaudio_messages, (void *)&am, 0) != pdTRUE) {
+    audio_queue_stats.dropped_sending++;
+    DEBUG_PRINTLN("queue_audio_message(): Queue is full, message dropped.");
+    return false;
+  }
+  audio_queue_stats.queued++;
+  return true;
+}
+
+
+// puts am in pending behind every message with the same or a higher priority.
+// a message that was cut off goes in front of the others with its priority instead, since it was already playing.
+// when pending is full the newest message with the lowest priority is dropped, which may be am.
+static void add_pending(const struct AudioMessage& am, bool in_front) {
+  uint16_t at = 0;
+  while (at < num_pending && (pending[at].priority > am.priority || (!in_front && pending[at].priority == am.priority))) {
+    at++;
+  }
+  if (num_pending == AUDIO_QUEUE_LENGTH) {
+    audio_queue_stats.dropped_pending++;
+    DEBUG_PRINTLN("add_pending(): Too many messages waiting, lowest priority message dropped.");
+    if (at == num_pending) {
+      return;
+    }
+    num_pending--;
+  }
+  memmove(&pending[at + 1], &pending[at], (num_pending - at)*sizeof(struct AudioMessage));
+  pending[at] = am;
+  num_pending++;
+}
+
+
+static void receive_audio_messages(void) {
+  struct AudioMessage am;
+  while (xQueueReceive(qaudio_messages, (void *)&am, 0) == pdTRUE) {
+    add_pending(am, false);
+  }
+  audio_queue_stats.depth = num_pending;
+  if (num_pending > audio_queue_stats.max_depth) {
+    audio_queue_stats.max_depth = num_pending;
+  }
+}
+
+
+// play() calls this between mp3 frames and stops when it returns true.
+// true means a message with a higher priority than the one playing is waiting.
+bool is_audio_preempted(void) {
+  if (playing_priority < 0) {
+    return false;
+  }
+  if (!preempted && uxQueueMessagesWaiting(qaudio_messages) > 0) {
+    receive_audio_messages();
+    preempted = (num_pending > 0 && pending[0].priority > playing_priority);
+  }
+  return preempted;
+}
+
+
+void aural_notifier(void* parameter) {
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(5));
+    receive_audio_messages();
+    if (num_pending == 0) {
+      is_audio_message_queued = false;
+      continue;
+    }
+
+    is_audio_message_queued = true;
+    struct AudioMessage am = pending[0];
+    num_pending--;
+    memmove(&pending[0], &pending[1], num_pending*sizeof(struct AudioMessage));
+    audio_queue_stats.depth = num_pending;
+
+    uint32_t wait_ms = millis() - am.queued_ms;
+    audio_queue_stats.wait_ms_total += wait_ms;
+    if (wait_ms > audio_queue_stats.wait_ms_max) {
+      audio_queue_stats.wait_ms_max = wait_ms;
+    }
+
+    playing_priority = am.priority;
+    preempted = false;
+    if (strlen(am.sound) > 0) {
+      //const char* http_sound_prefix = "http://";
+      //if (strncmp(am.sound, http_sound_prefix, strlen(http_sound_prefix)*sizeof(char)) == 0) {
+      if (strncmp(am.sound, HTTP_SOUND_PREFIX, strlen(HTTP_SOUND_PREFIX)*sizeof(char)) == 0) {
+        http_sound(am.sound);
+      }
+      else {
+        file_sound(am.sound);
+      }
+      if (!preempted) {
+        vTaskDelay(pdMS_TO_TICKS(750));
+      }
+    }
+
+    if (!preempted && strlen(am.description) > 0 && strlen(am.voice) > 0) {
+      tell(am.description, am.voice, am.timestamp, am.do_long_notify);
+      if (!preempted) {
+        vTaskDelay(pdMS_TO_TICKS(750));
+      }
+    }
+    playing_priority = -1;
+
+    if (preempted) {
+      // played again from the start once the messages that cut in are done. the wait is counted again from now.
+      DEBUG_PRINTLN("aural_notifier(): Cut off by a higher priority message.");
+      audio_queue_stats.preempted++;
+      am.queued_ms = millis();
+      add_pending(am, true);
+    }
+    else {
+      audio_queue_stats.played++;
+    }
+  }
+  vTaskDelete(NULL);
+}
@@ -1,21 +1,3 @@
-// events.json specification
-// d == description (max 100 chars), f == frequency, sd == start date, st == start time, ed == end date, et == end time, e == exclude, p == pattern, c == color, s == sound, v == voice
-// frequency: d == Daily, w == weekly, m == Monthly, y == Yearly
-// exclude: is an 8 bit number that stores the sum of the days of the week you wish to skip
-//          1 for Sunday, 2 for Monday, 4 for Tuesday, 8 for Wednesday, 16 for Thursday, 32 for Friday, 64 for Saturday
-//          for example, if you wish to exclude Saturday and Sunday, then set exclude to 1 + 64 => e:65
-//
-//{"events":[
-//           {"d":"Feed+Fish%2C+Morning","f":"d","sd":[2024,9,25],"st":[8,0,0],"ed":null,"et":null,"e":65,"p":2,"c":"0x00FF0000","s":"chime.mp3","v":"en-ca&v=Clara"},
-//           {"d":"Feed+Fish%2C+Afternoon","f":"d","sd":[2024,9,25],"st":[16,0,0],"ed":null,"et":null,"e":65,"p":0,"c":"0x000000FF","s":"chime.mp3","v":"en-ca&v=Clara"}
-//          ]
-//}
-//
-// descriptions are percent encoded by the frontend and stored in this format so they can be easily passed to the TTS API.
-// the backend trusts that the frontend gives it valid, preformatted data.
-// generally, not the best idea, but this is just a personal project and not implement formatting like percent encoding in the backend simplifies the code.
-
-
 #include <Arduino.h>
 #include <FS.h>
 //#include "credentials.h" // set const char *wifi_ssid and const char *wifi_password in include/credentials.h
@@ -29,9 +11,6 @@
 
 #include <FastLED.h>
 
-#include "ArduinoJson-v6.h"
-#include <StreamUtils.h>
-
 #include "Button2.h"
 
 #include "AudioFileSourceHTTPStream.h"
@@ -41,56 +20,24 @@
 #include "AudioOutputI2S.h"
 
 #include "driver/i2s.h"
+#include "esp_timer.h"
 
 #include <vector>
 
-// storage locations for animated matrices and playlists.
-// note the pathes are hardcoded in the HTML files, so changing these defines is not enough.
-// do not put a / at the end
-#define FILE_ROOT "/files"
-#define SND_ROOT FILE_ROOT "/snd"
-#define USR_ROOT FILE_ROOT "/usr"
+#include "config.h"
+#include "scheduler.h"
+#include "storage.h"
+#include "renderer.h"
+#include "audio_queue.h"
+#include "web_api.h"
 
 #define WIFI_CONNECT_TIMEOUT 10000 // milliseconds
 #define SOFT_AP_SSID "SmartButton"
 #define MDNS_HOSTNAME "smartbutton"
 
-#define DATA_PIN 16
-#define COLOR_ORDER GRB
-#define LED_STRIP_VOLTAGE 5
-#define LED_STRIP_MILLIAMPS 270
-#define HOMOGENIZE_BRIGHTNESS true
-
 #define BUTTON_PIN 26 
-
-#define EVENT_CHECK_INTERVAL 5000 // milliseconds. how frequently checks for events happening now should occur.
-
-#define DESCRIPTION_SIZE 301 // frontend allows up to 100 but with percent encoding the description could become much longer.
-#define SOUND_SIZE 101
-#define VOICE_SIZE 15 // longest voice string for voicerss: fr-ca&v=Olivia
-
-#define RANDOM_SOUND_MARKER "?????"
-#define HTTP_SOUND_PREFIX "http://"
-
-#define SENTINEL_EVENT_ID -1 // event.id is always non-negative, so -1 indicates never seen
-
-#undef DEBUG_CONSOLE
-#define DEBUG_CONSOLE Serial
-#if defined DEBUG_CONSOLE && !defined DEBUG_PRINTLN
-  #define DEBUG_BEGIN(x)     DEBUG_CONSOLE.begin (x)
-  #define DEBUG_PRINT(x)     DEBUG_CONSOLE.print (x)
-  #define DEBUG_PRINTDEC(x)     DEBUG_PRINT (x, DEC)
-  #define DEBUG_PRINTLN(x)  DEBUG_CONSOLE.println (x)
-  #define DEBUG_PRINTF(...) DEBUG_CONSOLE.printf(__VA_ARGS__)
-  #define DEBUG_FLUSH()     DEBUG_CONSOLE.flush ()
-#else
-  #define DEBUG_BEGIN(x)
-  #define DEBUG_PRINT(x)
-  #define DEBUG_PRINTDEC(x)
-  #define DEBUG_PRINTLN(x)
-  #define DEBUG_PRINTF(...)
-  #define DEBUG_FLUSH()
-#endif
+#define BUTTON_SETTLE_TIME 1000 // milliseconds. loop() keeps polling the button this long after it changes, so Button2 can tell clicks apart.
+#define EVENT_TIMER_SLACK 2000 // microseconds the event timer is armed past the second an event is due in. see arm_event_timer().
 
 struct Timezone {
   // TZ is only set at boot, so it is possible for iana_tz and posix_tz to have been updated from default values, but not put into effect yet.
@@ -113,120 +60,26 @@ bool dns_up = false;
 
 bool restart_needed = false;
 
-// any changes to LEDS_ORIGIN_OFFSET here will be overwritten.
-// LEDS_ORIGIN_OFFSET is set in the frontend.
-// and DEFAULT_LEDS_ORIGIN_OFFSET is set in platformio.ini.
-// since you may be physically limited where you place the first LED when assembling the button
-// LEDS_ORIGIN_OFFSET lets you adjust where the apparent origin is. for example, if the first
-// LED is physically wired at 1 o'clock you change LEDS_ORIGIN_OFFSET to a value different from
-// 0 such that origin *appears* as if it is at 6 o'clock.
-uint16_t LEDS_ORIGIN_OFFSET = 0;
-// any changes to NUM_LEDS here will be overwritten.
-// NUM_LEDS is set in the frontend.
-// and DEFAULT_NUM_LEDS is set in platformio.ini.
-uint16_t NUM_LEDS = 0;
-CRGB* leds;
-uint8_t homogenized_brightness = 255;
-
-bool is_audio_message_queued = false;
 Button2 button;
 
-struct Event {
-  uint16_t id;
-  struct tm datetime;
-  char frequency;
-  struct tm end_datetime;
-  char description[DESCRIPTION_SIZE];
-  uint8_t exclude;
-  uint8_t pattern;
-  uint32_t color;
-  char sound[SOUND_SIZE];
-  bool is_random_sound;
-  char voice[VOICE_SIZE];
-  time_t timestamp;
-};
-
-std::vector<Event> events;
-bool events_reload_needed = false;
-
-struct AudioMessage {
-  uint32_t id;
-  char description[DESCRIPTION_SIZE];
-  char sound[SOUND_SIZE];
-  char voice[VOICE_SIZE];
-  time_t timestamp;
-  bool do_long_notify;
-};
-
-QueueHandle_t qaudio_messages = xQueueCreate(25, sizeof(struct AudioMessage));
-
-enum Pattern {
-  SOLID = 0,
-  BREATHE = 1,
-  BLINK = 2,
-  SPIN = 3,
-  TWINKLE = 4
-};
-
-enum SpecialColor {
-  RAINBOW     = 0x01000000,
-  RED_GREEN   = 0x01000001,
-  ORANGE_BLUE = 0x01000002,
-  YELLOW_PURPLE = 0x01000003
-};
-
-std::vector<uint8_t> patterns;
-std::vector<uint8_t> special_colors;
-
-uint8_t num_special_colors = 0;
-
-const char* stored_file_list = FILE_ROOT "/file_list.json";
-//const char* sound_URLs = FILE_USR "/sound_URLs.json";
-
-String patterns_json;
-String special_colors_json;
-
-bool is_wait_over(uint16_t interval);
-bool finished_waiting(uint16_t interval);
-void homogenize_brightness(void);
-void show(void);
-
-void breathing(uint16_t draw_interval);
-void blink(uint16_t draw_interval, uint8_t num_blinks, uint8_t num_intervals_off);
-//uint16_t forwards(uint16_t index_in);
-uint16_t backwards(uint16_t index_in);
-void spin(uint16_t draw_interval, uint16_t(*dfp)(uint16_t));
-void twinkle(uint16_t draw_interval);
-void fill_gradient_RGB_circular(CRGB* leds, CRGB start_color, CRGB end_color);
-void fill(uint32_t color);
-void visual_reset(void);
-void visual_notifier(void);
+TaskHandle_t loop_task = NULL;
+esp_timer_handle_t event_timer = NULL;
+time_t event_timer_deadline = 0; // next_fire the event timer is armed for, 0 if it is not armed
+volatile bool events_due = false;
+volatile uint32_t button_changed_ms = 0;
 
 //void status_callback(void *cbData, int code, const char *string);
 void play(AudioFileSource* file);
 bool is_valid_mp3_URL(const char* url);
-void http_sound(const char* url);
-void tell(const char* description, const char* voice, time_t timestamp, bool do_long_notify);
-void file_sound(String filename);
-void aural_notifier(void* parameter);
-
-bool create_patterns_list(void);
-bool create_special_colors_list(void);
-
-void fill_in_datetime(tm* datetime);
-tm new_time(uint32_t value, char unit);
-tm refresh_datetime(tm datetime, char frequency);
-bool is_expired(tm datetime, tm end_datetime);
-uint16_t new_id(void);
-void set_random_sound(char* sound, size_t sound_len);
-bool load_events_file(void);
-bool save_file(String fs_path, String json, String& message);
-void check_for_recent_events(uint16_t interval);
 
 void single_click_handler(Button2& b);
 void long_click_handler(Button2& b);
 
 bool verify_timezone(const String iana_tz);
+void event_timer_callback(void* arg);
+void button_isr(void);
+void arm_event_timer(void);
+void idle_wait(void);
 void espDelay(uint32_t ms);
 bool attempt_connect(void);
 String get_ip(void);
@@ -243,339 +96,6 @@ time_t time_provider();
 
 
 
-// If two functions running close to each other both call is_wait_over()
-// the one with the shorter interval will reset the timer such that the
-// function with the longer interval will never see its interval has
-// elapsed, therefore a second function that does the same thing as
-// is_wait_over() has been added. This is only a concern when a pattern
-// function and an overlay function are both called at the same time.
-// Patterns should use is_wait_over() and overlays should use finished_waiting(). 
-bool is_wait_over(uint16_t interval) {
-    static uint32_t pm = 0; // previous millis
-    if ( (millis() - pm) > interval ) {
-        pm = millis();
-        return true;
-    }
-    else {
-        return false;
-    }
-}
-
-
-bool finished_waiting(uint16_t interval) {
-    static uint32_t pm = 0; // previous millis
-    if ( (millis() - pm) > interval ) {
-        pm = millis();
-        return true;
-    }
-    else {
-        return false;
-    }
-}
-
-
-// When FastLED's power management functions are used FastLED dynamically adjusts the brightness level to be as high as possible while
-// keeping the power draw near the specified level. This can lead to the brightness level of an animation noticeably increasing when
-// fewer LEDs are lit and the brightness noticeably dipping when more LEDs are lit or their colors change.
-// homogenize_brightness() learns the lowest brightness level of all the animations and uses it across every animation to keep a consistent
-// brightness level. This will lead to dimmer animations and power usage almost always a good bit lower than what the FastLED power
-// management function was set to aim for. Set the #define for HOMOGENIZE_BRIGHTNESS to false to disable this feature.
-void homogenize_brightness(void) {
-    uint8_t max_brightness = calculate_max_brightness_for_power_vmA(leds, NUM_LEDS, homogenized_brightness, LED_STRIP_VOLTAGE, LED_STRIP_MILLIAMPS);
-    if (max_brightness < homogenized_brightness) {
-        homogenized_brightness = max_brightness;
-    }
-}
-
-
-void show(void) {
-  homogenize_brightness();
-  //FastLED.setBrightness(homogenized_brightness);
-  FastLED.show();
-}
-
-
-uint16_t idx(uint16_t index_in) {
-  return (LEDS_ORIGIN_OFFSET + index_in) % NUM_LEDS;
-}
-
-
-uint8_t br_delta = 0;
-void breathing(uint16_t draw_interval) {
-  const uint8_t min_brightness = 2;
-  if (finished_waiting(draw_interval)) {
-    // since FastLED is managing the maximum power delivered use the following function to find the _actual_ maximum brightness allowed for
-    // these power consumption settings. setting brightness to a value higher that max_brightness will not actually increase the brightness.
-    uint8_t max_brightness = calculate_max_brightness_for_power_vmA(leds, NUM_LEDS, homogenized_brightness, LED_STRIP_VOLTAGE, LED_STRIP_MILLIAMPS);
-    uint8_t b = scale8(triwave8(br_delta), max_brightness-min_brightness)+min_brightness;
-
-    FastLED.setBrightness(b);
-
-    br_delta++;
-  }
-}
-
-
-uint8_t bl_count = 0;
-void blink(uint16_t draw_interval, uint8_t num_blinks, uint8_t num_intervals_off) {
-  if (finished_waiting(draw_interval)) {
-    if (bl_count < (2*num_blinks)) {
-      uint8_t b = (bl_count % 2 == 0) ? homogenized_brightness : 0;
-      FastLED.setBrightness(b);
-    }
-    bl_count++;
-    if (bl_count >= 2*num_blinks + num_intervals_off-1) {
-      bl_count = 0;
-    }
-  }
-}
- 
-
-//uint16_t forwards(uint16_t index_in) {
-//  return index_in;
-//}
-
-
-uint16_t backwards(uint16_t index_in) {
-  return idx((NUM_LEDS-1)-index_in);
-}
-
-
-void spin(uint16_t draw_interval, uint16_t(*dfp)(uint16_t)) {
-  if (finished_waiting(draw_interval)) {
-    CRGB color0 = leds[(*dfp)(idx(NUM_LEDS-1))];
-    for(uint16_t i = NUM_LEDS-1; i > 0; i--) {
-      leds[(*dfp)(idx(i))] = leds[(*dfp)(idx(i-1))];
-    }
-    leds[(*dfp)(idx(0))] = color0;
-  }
-}
-
-
-void twinkle(uint16_t draw_interval) {
-  if (finished_waiting(draw_interval)) {
-    for(uint16_t i = 0; i < NUM_LEDS; i++) {
-      if (random8() < 16) {
-        // no real reason to use idx() since these are random indices
-        leds[i] = CRGB::White - leds[i];
-      }
-    }
-  }
-}
-
-
-void fill_gradient_RGB_circular(CRGB* leds, CRGB start_color, CRGB end_color) {
-  CRGBPalette16 palette;
-  for (uint8_t i = 0; i < 16; i++) {
-      float ratio = i / 15.0;
-      palette[i] = blend(start_color, end_color, ratio*255);
-  }
-  for (uint16_t i = 0; i < NUM_LEDS; i++) {
-    leds[idx(i)] = ColorFromPalette(palette, (i*255)/NUM_LEDS);
-  }
-}
-
-
-void fill(uint32_t color) {
-  // regular RGB color only uses 24 bits but if color is stored in 32 bits
-  // we can utilize the unused upper bits to indicate a color is special
-  // colors less than or equal to 0x00FFFFFF are normal RGB colors
-  uint8_t color_flag = (color >> 24);
-  if (color_flag == 0x00) {
-    fill_solid(leds, NUM_LEDS, color);
-  }
-  else if (color_flag == 0x01) {
-    // 0x01------ flag indicates special colors
-    if (static_cast<SpecialColor>(color) == RAINBOW) {
-      // cannot manipulate the LED indices with idx() for fill_rainbow_circular, but can change the hue at leds[0] which
-      // accomplishes the same goal of changing the apparent origin of the LEDs
-      const uint16_t hueChange = 65535 / (uint16_t) NUM_LEDS;  // hue change for each LED, * 256 for precision (256 * 256 - 1)
-      uint16_t initialhue = (uint8_t)((LEDS_ORIGIN_OFFSET*hueChange) >> 8);  // assign new hue with precise offset (as 8-bit)
-      fill_rainbow_circular(leds, NUM_LEDS, initialhue);
-    }
-    else {
-      CRGB color1 = CRGB::Black;
-      CRGB color2 = CRGB::Pink;
-      if (color == RED_GREEN) {
-        color1 = CRGB::Red;
-        color2 = CRGB::Green;
-      }
-      else if (color == ORANGE_BLUE) {
-        color1 = CRGB::Orange;
-        color2 = CRGB::Blue;
-      }
-      else if (color == YELLOW_PURPLE) {
-        color1 = CRGB::Yellow;
-        color2 = CRGB::Purple;
-      }
-      //fill_gradient_RGB() shows colors more distinctly than fill_gradient()
-      //half and half looks better than a gradient since the button cover already diffuses the color
-      uint8_t i = 0;
-      while(i < NUM_LEDS/2) {
-        leds[idx(i)] = color1;
-        i++;
-      }
-      while(i < NUM_LEDS) {
-        leds[idx(i)] = color2;
-        i++;
-      }
-    }
-  }
-  else if (color_flag == 0x02) {
-    // 0x02------ flag indicates to fade color across gradient fill
-    color = color & 0x00FFFFFF;
-    CRGB color_dim = color;
-    color_dim.nscale8(20); // lower numbers are closer to black
-    fill_gradient_RGB_circular(leds, color, color_dim);
-  }
-  else {
-    // black and pink is used to indicate something went wrong during testing
-    fill_gradient_RGB_circular(leds, CRGB::Black, CRGB::Pink);
-  }
-}
-
-
-void visual_reset(void) {
-  br_delta = 0;
-  bl_count = 0;
-  finished_waiting(0); // effectively resets timer used for visual effects
-  FastLED.clear();
-}
-
-
-// last_id_seen needs to be global so it can be set back to the default by long_click_handler()
-// otherwise a reoccurrence of an event with the same id as last_id_seen may not be shown.
-int32_t last_id_seen = SENTINEL_EVENT_ID; // event.id is always non-negative, so last_id_seen of -1 indicates never seen
-void visual_notifier(void) {
-  // NOTE:
-  // a design decision was made that the color used by a pattern will not evolve over time.
-  // shifting colors are visually appealing, but they are counter productive to serving as a visual indicator
-  // for example: one event is blinking blue, and another event is blinking with a shifting color
-  //              the shifting color will eventually show blue, so you would have two separate events showing
-  //              the same visual indicator.
-  const uint32_t SHOW_TIME = 4000; // milliseconds
-  static uint16_t i = 0;
-  static uint32_t pm = 0;
-  static bool refill = true;
-  if (!events.empty()) {
-    if (i >= events.size()) {
-      // if an event was deleted i might be greater than the number of events, so reset it.
-      i = 0;
-    }
-    struct Event event = events[i];
-    if (event.timestamp != 0) {
-      // if timestamp is 0 then event has not happened since last time notices were cleared
-      // so there is no need to show a visual notice for it
-
-      if (event.id != last_id_seen) {
-        // by tracking the last_id_seen we can determine if a new notice is about to be shown
-        // if it is new notice then reinitialize
-        // should only reinitialize once for the SHOW_TIME interval so the pattern can be
-        // animated correctly instead of being restarted over and over
-        last_id_seen = event.id;
-        refill = true;
-        visual_reset();
-      }
-
-      uint8_t pattern = event.pattern;
-      uint8_t randomness = (uint8_t)event.timestamp;
-      if (pattern == 255) {
-        // 255 indicates a random pattern should be used
-        pattern = randomness % patterns.size();
-      }
-      uint32_t color = event.color;
-      if (color == 0xFFFFFFFF) {
-        // 0xFFFFFFFF indicates a random color should be used
-        bool do_basic = randomness % 3;
-
-        if (do_basic) {
-          color = (uint32_t)(CRGB)CHSV((randomness % 255), 255, 255);
-          color &= 0x00FFFFFF; // make sure the upper bits are zero to indicate a basic color
-        }
-        else {
-          // do special color
-          color = 0x01000000 + (randomness % special_colors.size());
-        }
-      }
-
-      // for DEBUGGING
-      //if (refill) {
-      //  DEBUG_PRINT("description: ");
-      //  DEBUG_PRINTLN(event.description);
-      //  DEBUG_PRINT("pattern: ");
-      //  DEBUG_PRINTLN(pattern);
-
-      //  DEBUG_PRINT("color: ");
-      //  char hex_color[11];
-      //  snprintf(hex_color, sizeof(hex_color), "0x%08lX", color);
-      //  DEBUG_PRINTLN(hex_color);
-      //}
-
-      switch (pattern) {
-        case SOLID:
-          FastLED.setBrightness(homogenized_brightness);
-          if (refill) {
-            refill = false;
-            fill(color);
-          }
-          break;
-        case BREATHE:
-          if (refill) {
-            refill = false;
-            fill(color);
-          }
-          breathing(10);
-          break;
-        case BLINK:
-          //FastLED.setBrightness(homogenized_brightness); // do not use this here. blink changes brightness.
-          if (refill) {
-            refill = false;
-            fill(color);
-          }
-          blink(200, 3, 10);
-          break;
-        case SPIN:
-          FastLED.setBrightness(homogenized_brightness);
-          if (refill) {
-            refill = false;
-            if (color <= 0x00FFFFFF) {
-              // 0x02------ flag indicates to fade color across gradient fill
-              // the change in brightness across the fill makes it possible to see the spinning motion
-              color += (0x02 << 24);
-            }
-            fill(color);
-          }
-          // complete rotation about every 2 seconds independent of the number of LEDs
-          spin(2000/NUM_LEDS, &backwards);
-          break;
-        case TWINKLE:
-          FastLED.setBrightness(homogenized_brightness);
-          if (is_wait_over(100)) {
-            // twinkles should only show momentarily
-            // by refilling every time the twinkles from the previous draw disappear
-            fill(color);
-            twinkle(0);
-          }
-          break;
-        default:
-          break;
-      }
-    }
-
-    // iterate if the event has been shown for SHOW_TIME or event should not be shown
-    if ((millis()-pm) > SHOW_TIME || event.timestamp == 0) {
-      pm = millis();
-      i = (i+1) % events.size();
-    }
-
-    show();
-  }
-  // might not be a bad idea to use else{} and call visual_reset() if the events list is empty to be safe
-  // but it would be called every iteration of loop() when events list is empty
-}
-
-
-
 // Called when there's a warning or error (like a buffer underflow or decode hiccup)
 //void StatusCallback(void *cbData, int code, const char *string) {
 //  const char *ptr = reinterpret_cast<const char *>(cbData);
@@ -608,7 +128,8 @@ void play(AudioFileSource* file) {
         DEBUG_FLUSH();
         vTaskDelay(pdMS_TO_TICKS(5));
       }
-      if (!mp3->loop() || mp3_stop_requested) {
+      // is_audio_preempted() is checked between frames so a higher priority message can cut in
+      if (!mp3->loop() || mp3_stop_requested || is_audio_preempted()) {
         mp3->stop();
         DEBUG_PRINTLN("Finished playing.");
         DEBUG_FLUSH();
@@ -735,672 +256,6 @@ void file_sound(const char* filename) {
 }
 
 
-void aural_notifier(void* parameter) {
-  static uint16_t i = 0;
-  for (;;) {
-    vTaskDelay(pdMS_TO_TICKS(5));
-    struct AudioMessage am;
-    if (xQueueReceive(qaudio_messages, (void *)&am, 0) == pdTRUE) {
-      is_audio_message_queued = true;
-      if (strlen(am.sound) > 0) {
-        //const char* http_sound_prefix = "http://";
-        //if (strncmp(am.sound, http_sound_prefix, strlen(http_sound_prefix)*sizeof(char)) == 0) {
-        if (strncmp(am.sound, HTTP_SOUND_PREFIX, strlen(HTTP_SOUND_PREFIX)*sizeof(char)) == 0) {
-          http_sound(am.sound);
-        }
-        else {
-          file_sound(am.sound);
-        }
-        vTaskDelay(pdMS_TO_TICKS(750));
-      }
-
-      if (strlen(am.description) > 0 && strlen(am.voice) > 0) {
-        tell(am.description, am.voice, am.timestamp, am.do_long_notify);
-        vTaskDelay(pdMS_TO_TICKS(750));
-      }
-
-    }
-    else {
-      is_audio_message_queued = false;
-    }
-  }
-  vTaskDelete(NULL);
-}
-
-
-// create_patterns_list() and create_special_colors_list() make development easier, but once you are happy with the patterns
-// and special colors you may wish to copy their resulting output and hardcode the JSON to their respective variables in setup()
-// in place of running these functions.
-//
-// creating the patterns list procedurally rather than hardcoding it allows for rearranging and adding to the patterns that appear
-// in the frontend more easily. this function creates the list based on what is in the enum Pattern, so changes to that enum
-// are reflected here. assigning a new number to the pattern will change where the pattern falls in the list sent to the frontend.
-// setting the pattern to a number of 50 or greater will remove it from the list sent to the frontend.
-// if a new pattern is created a new case pattern_name will still need to be set here.
-bool create_patterns_list(void) {
-  const uint8_t pattern_limit = 50;
-  static Pattern pattern_value = static_cast<Pattern>(0);
-  String pattern_name;
-  bool match = false;
-  static bool first = true;
-  bool finished = false;
-  switch(pattern_value) {
-    default:
-        // up to 50 patterns. not every number between 0 and 49 needs to represent a pattern.
-        // doing it like this makes it easy to add more patterns or remove them by commenting them out. 
-        // the upper limit of 50 is arbitrary, it could be increased up to 254
-        // 255 is used to indicate a pattern be randomly chosen by the backend
-        if (pattern_value >= pattern_limit) {
-          pattern_value = static_cast<Pattern>(0);
-          finished = true;
-        }
-        break;
-    // Note: it does not make sense to present NO_PATTERN as an option in the frontend
-    case SOLID:
-        pattern_name = "Solid";
-        match = true;
-        break;
-    case BREATHE:
-        pattern_name = "Breathe";
-        match = true;
-        break;
-    case BLINK:
-        pattern_name = "Blink";
-        match = true;
-        break;
-    case SPIN:
-        pattern_name = "Spin";
-        match = true;
-        break;
-    case TWINKLE:
-        pattern_name = "Twinkle";
-        match = true;
-        break;
-  }
-  if (match) {
-    patterns.push_back(pattern_value);
-    if (!first) {
-      patterns_json += ",";
-    }
-    size_t buffsize = snprintf(nullptr, 0, "{\"n\":\"%s\",\"v\":\"%d\"}", pattern_name.c_str(), pattern_value);
-    char* item = new char[buffsize + 1];
-    snprintf(item, buffsize + 1, "{\"n\":\"%s\",\"v\":\"%d\"}", pattern_name.c_str(), pattern_value);
-    patterns_json += item;
-    delete[] item;
-    first = false;
-  }
-  if (!finished) {
-    pattern_value = static_cast<Pattern>(pattern_value+1);
-  }
-  return finished;
-}
-
-
-// this is based on the same principles as create_patterns_list() refer to its comments
-bool create_special_colors_list(void) {
-  const uint32_t special_color_limit = 0x01000032; // 50 base ten is 0x32 in hex
-  //const uint32_t special_color_limit = 0x0100000A; // 10 base ten is 0xA in hex
-  static SpecialColor special_color_value = static_cast<SpecialColor>(0x01000000);
-  std::string special_color_name;
-  bool match = false;
-  static bool first = true;
-  bool finished = false;
-  switch(special_color_value) {
-    default:
-        // up to 50 special colors. not every number between 0 and 49 needs to represent a special color.
-        // doing it like this makes it easy to add more special colors or remove them by commenting them out. 
-        // the upper limit of 50 is arbitrary
-        if (special_color_value >= special_color_limit) {
-          special_color_value = static_cast<SpecialColor>(0x01000000);
-          finished = true;
-        }
-        break;
-    case RAINBOW:
-        special_color_name = "Rainbow";
-        match = true;
-        break;
-    case RED_GREEN:
-        special_color_name = "Red and Green";
-        match = true;
-        break;
-    case ORANGE_BLUE:
-        special_color_name = "Orange and Blue";
-        match = true;
-        break;
-    case YELLOW_PURPLE:
-        special_color_name = "Yellow and Purple";
-        match = true;
-        break;
-  }
-  if (match) {
-    special_colors.push_back(special_color_value);
-    if (!first) {
-      special_colors_json += ",";
-    }
-    size_t buffsize = snprintf(nullptr, 0, "{\"n\":\"%s\",\"v\":\"0x%08lx\"}", special_color_name.c_str(), special_color_value);
-    char* item = new char[buffsize + 1];
-    snprintf(item, buffsize + 1, "{\"n\":\"%s\",\"v\":\"0x%08lx\"}", special_color_name.c_str(), special_color_value);
-    special_colors_json += item;
-    delete[] item;
-    first = false;
-  }
-  if (!finished) {
-    special_color_value = static_cast<SpecialColor>(special_color_value+1);
-  }
-  return finished;
-}
-
-
-
-void fill_in_datetime(tm* _datetime) {
-//#if defined DEBUG_CONSOLE
-//  char buffer[100];
-//  // missing timezone and empty parenthesis indicate _datetime->tm_isdst is -1
-//  strftime(buffer, sizeof(buffer), "%a %Y/%m/%d %H:%M:%S %Z (%z)", _datetime);
-//  DEBUG_PRINTF("\nfill_in_datetime() before: %s\n", buffer);
-//#endif
-
-  time_t t = mktime(_datetime);
-  localtime_r(&t, _datetime); // tm_wday, tm_yday, and tm_isdst are filled in with the proper values
-
-//#if defined DEBUG_CONSOLE
-//  strftime(buffer, sizeof(buffer), "%a %Y/%m/%d %H:%M:%S %Z (%z)", _datetime);
-//  DEBUG_PRINTF("fill_in_datetime() after: %s\n", buffer);
-//#endif
-}
-
-
-tm new_time(uint32_t value, char unit) {
-  struct tm next_event = {0};
-  time_t now;
-  time(&now);
-  localtime_r(&now, &next_event);
-
-  next_event.tm_isdst = -1; // A negative value of tm_isdst causes mktime to attempt to determine if Daylight Saving Time was in effect in the specified time. 
-
-  bool updated = false;
-  switch(unit) {
-    case 's':
-      next_event.tm_sec += value;
-      break;
-    case 'm':
-      next_event.tm_min += value;
-      break;
-    case 'h':
-      next_event.tm_hour += value;
-      break;
-    case 'd':
-      next_event.tm_mday += 1;
-      break;
-    default:
-      break;
-  }
-  fill_in_datetime(&next_event);
-
-  return next_event;
-}
-
-
-// updates recurring events, so the next occurrence is in the future.
-tm refresh_datetime(tm datetime, char frequency) {
-  struct tm local_now = {0};
-  struct tm next_event = {0};
-  time_t now;
-  time(&now);
-  localtime_r(&now, &local_now);
-  
-  next_event = datetime;
-  next_event.tm_isdst = -1; // A negative value of tm_isdst causes mktime to attempt to determine if Daylight Saving Time was in effect in the specified time. 
-
-  time_t tnow = mktime(&local_now);
-  time_t t2 = mktime(&next_event);
-  if (t2 <= tnow) {
-    if (frequency == 'o') { // once, one-shot
-      // the code that detects if an event is happening now allows a window of time an event can
-      // be close to. this helps prevent missed events, but it can also lead to the event
-      // being detected multiple times over the window.
-      // to prevent multiple detections reoccuring events are moved to their next datetime in the
-      // future. however one-shot events do not have a future. therefore we want to change the
-      // datetime to the far past to move the event a way from the *happening now* detection window.
-
-      next_event.tm_sec = 0;
-      next_event.tm_min = 0;
-      next_event.tm_hour = 0;
-      next_event.tm_mday = 1;
-      next_event.tm_mon = 0;
-      next_event.tm_year = 70;
-
-    }
-    //else if (frequency == 'd') { // debug testing
-    //  next_event.tm_mday = local_now.tm_mday;
-    //  next_event.tm_mon = local_now.tm_mon;
-    //  next_event.tm_year = local_now.tm_year;
-    //  t2 = mktime(&next_event);
-    //  if (t2 <= tnow) {
-    //    //next_event.tm_mday += 1;
-    //    next_event.tm_sec = local_now.tm_sec;
-    //    next_event.tm_min = local_now.tm_min + 2;
-    //    next_event.tm_hour = local_now.tm_hour;
-    //  }
-    //}
-    else if (frequency == 'd') { // daily
-      next_event.tm_mday = local_now.tm_mday;
-      next_event.tm_mon = local_now.tm_mon;
-      next_event.tm_year = local_now.tm_year;
-      t2 = mktime(&next_event);
-      if (t2 <= tnow) {
-        // equivalent to adding 24 hours.
-        // if the next day has 23 or 25 hours this will result in the hour being off by 1
-        next_event.tm_mday += 1;
-      }
-    }
-    else if (frequency == 'w') { // weekly
-      next_event.tm_mday = local_now.tm_mday;
-      next_event.tm_mon = local_now.tm_mon;
-      next_event.tm_year = local_now.tm_year;
-      t2 = mktime(&next_event);
-      if (t2 <= tnow) {
-        next_event.tm_mday += 1;
-        next_event.tm_mday += ((datetime.tm_wday - 1 + 7 - local_now.tm_wday) % 7);
-      }
-      else {
-        next_event.tm_mday += ((datetime.tm_wday + 7 - local_now.tm_wday) % 7);
-      }
-    }
-    else if (frequency == 'm') { // monthly
-      next_event.tm_mday = datetime.tm_mday;
-      next_event.tm_mon = local_now.tm_mon;
-      next_event.tm_year = local_now.tm_year;
-      t2 = mktime(&next_event);
-      if (t2 <= tnow) {
-        next_event.tm_mon += 1;
-      }
-      t2 = mktime(&next_event);
-      localtime_r(&t2, &next_event);
-      // this corrects for tm_mday being altered when it starts as 31, but the next month only has 30 days.
-      // likewise this corrects for tm_mday being 29, 30, or 31, but the next month is February which may cause tm_mday to be altered.
-      if (next_event.tm_mday != datetime.tm_mday) {
-        next_event.tm_mday = datetime.tm_mday;
-      }
-    }
-    else if (frequency == 'y') { // yearly
-      next_event.tm_mday = datetime.tm_mday;
-      next_event.tm_mon = datetime.tm_mon;
-      next_event.tm_year = local_now.tm_year;
-      t2 = mktime(&next_event);
-      if (t2 <= tnow) {
-        // do while() handles a "yearly" event set on Feb 29. in all other cases the do block will only run once.
-        do {
-          next_event.tm_year += 1;
-          t2 = mktime(&next_event);
-          localtime_r(&t2, &next_event);
-        }
-        while (next_event.tm_mday != datetime.tm_mday && next_event.tm_mon != datetime.tm_mon);
-      }
-    }
-  }
-
-  t2 = mktime(&next_event);
-  if (t2 <= tnow) {
-    // if still in the past set it to the Unix Epoch to make it clear the event no longer occurs
-    // no DST. necessary for mktime() to give the exact Unix Epoch
-    next_event = {.tm_sec = 0, .tm_min = 0, .tm_hour = 0, .tm_mday = 1, .tm_mon = 0, .tm_year = 70, .tm_wday = 4, .tm_yday = 0, .tm_isdst = 0};
-    t2 = mktime(&next_event);
-  }
-  localtime_r(&t2, &next_event); // tm_wday, tm_yday, and tm_isdst are filled in with the proper values
-
-  // if updating the event causes it to cross a daylight saving begin or end time then tm_hour will be off by 1.
-  // since we just processed the event through mktime and localtime_r the event should be well formed
-  // so we can fix the off by one error by setting the hour back to the original hour passed to this function
-  next_event.tm_hour = datetime.tm_hour;
-
-
-  return next_event;
-}
-
-
-bool is_expired(tm datetime, tm end_datetime) {
-  struct tm local_now = {0};
-  time_t now;
-  time(&now);
-  localtime_r(&now, &local_now);
-  
-  datetime.tm_isdst = -1; // A negative value of tm_isdst causes mktime to attempt to determine if Daylight Saving Time was in effect in the specified time. 
-  end_datetime.tm_isdst = -1;
-
-  time_t tnow = mktime(&local_now);
-  time_t tdt = mktime(&datetime);
-  time_t tend = mktime(&end_datetime);
-
-  if (tdt <= tnow) {
-    DEBUG_PRINTLN("expired: in past\n");
-    return true;
-  }
-
-  if (tdt >= tend && !(end_datetime.tm_year == 70 && end_datetime.tm_mon == 0 && end_datetime.tm_mday == 1)) {
-    if (tdt >= tend) {
-      DEBUG_PRINTLN("expired: after end date\n");
-      return true;
-    }
-  }
-
-  return false;
-}
-
-
-uint16_t new_id(bool reset) {
-  static uint16_t next_id = 0;
-  if (reset) {
-    next_id = 0;
-    return next_id;
-  }
-  assert(next_id != UINT16_MAX); // if false, going to rollover on next call. this many events is not supported.
-  return next_id++;
-}
-
-
-void set_random_sound(char* sound, size_t sound_len) {
-  if (sound == NULL || sound_len == 0) return;
-
-  File file = LittleFS.open(stored_file_list, "r");
-
-  if (!file && !file.available()) {
-    return;
-  }
-
-  DynamicJsonDocument doc(24576);
-  ReadBufferingStream bufferedFile(file, 64);
-  DeserializationError error = deserializeJson(doc, bufferedFile);
-  file.close();
-
-  if (error) {
-    DEBUG_PRINT("deserializeJson() failed: ");
-    DEBUG_PRINTLN(error.c_str());
-    restart_needed = true;
-    return;
-  }
-
-  JsonObject object = doc.as<JsonObject>();
-  JsonArray jsnd = doc[F("/files")][F("snd")].as<JsonArray>();
-
-  if (jsnd.isNull() || jsnd.size() == 0) {
-    return;
-  }
-  uint32_t index = random(jsnd.size());
-  snprintf(sound, sound_len, "%s", jsnd[index].as<const char*>());
-}
-
-
-bool load_events_file() {
-  events.clear(); // does it make sense to clear even if the json file is unavailable or invalid?
-  (void)new_id(true); // reset
-  last_id_seen = SENTINEL_EVENT_ID;
-
-  File file = LittleFS.open(USR_ROOT "/events.json", "r");
-  
-  if (!file && !file.available()) {
-    return true;
-  }
-
-  DynamicJsonDocument doc(24576); // 25 events with description size of 300, sound size of 14, and voice size of 14
-  ReadBufferingStream bufferedFile(file, 64);
-  DeserializationError error = deserializeJson(doc, bufferedFile);
-  file.close();
-
-  if (error) {
-    DEBUG_PRINT("deserializeJson() failed: ");
-    DEBUG_PRINTLN(error.c_str());
-    restart_needed = true;
-    return true;
-  }
-
-  JsonObject object = doc.as<JsonObject>();
-  JsonArray jevents = object[F("events")];
-  if (jevents.isNull() || jevents.size() == 0) {
-    return true;
-  }
-
-  uint16_t id = 0;
-  for (uint16_t i = 0; i < jevents.size(); i++) {
-    JsonObject jevent = jevents[i];
-    JsonArray start_date = jevent[F("sd")];
-    JsonArray event_time = jevent[F("st")];
-    if (!start_date.isNull() && start_date.size() == 3 && !event_time.isNull() && (event_time.size() == 2 || event_time.size() == 3)) {
-      struct tm datetime = {0};
-      datetime.tm_year = (start_date[0].as<uint16_t>()) - 1900; // entire year is stored in json file to make it more human readable.
-      datetime.tm_mon = (start_date[1].as<uint8_t>()) - 1; // time library has January as 0, but json file represents January with 1 to make it more human readable.
-      datetime.tm_mday = start_date[2].as<uint8_t>();
-      datetime.tm_hour = event_time[0].as<uint8_t>();
-      datetime.tm_min = event_time[1].as<uint8_t>();
-      if (event_time.size() == 2) {
-        // html time element on mobile may not allow setting seconds
-        datetime.tm_sec = 0;
-      }
-      if (event_time.size() == 3) {
-        datetime.tm_sec = event_time[2].as<uint8_t>();
-      }
-      datetime.tm_isdst = -1;
-
-      // refresh_datetime() uses tm_wday so it needs to be corrected before we pass datetime to refresh_datetime()
-      fill_in_datetime(&datetime); // tm_wday, tm_yday, and tm_isdst are filled in with the proper values
-
-      char frequency = 'o';
-      if (!jevent[F("f")].isNull()) {
-        frequency = jevent[F("f")].as<const char*>()[0];
-      }
-
-      int8_t num_occurences = 0;
-      if (!jevent[F("o")].isNull()) {
-        num_occurences = jevent[F("o")].as<int8_t>();
-      }
-
-      const char* description = "";
-      if (!jevent[F("d")].isNull()) {
-        description = jevent[F("d")];
-      }
-      // this is the description from the frontend. if it is too long it will be shortened when stored in event.description
-      DEBUG_PRINT("\ndescription: ");
-      DEBUG_PRINTLN(description);
-
-
-#if defined DEBUG_CONSOLE
-      char buffer[100];
-      strftime(buffer, sizeof(buffer), "%a %Y/%m/%d %H:%M:%S %Z (%z)", &datetime);
-      DEBUG_PRINTF("original datetime : %s\n", buffer);
-#endif
-
-      datetime = refresh_datetime(datetime, frequency);
-
-#if defined DEBUG_CONSOLE
-      strftime(buffer, sizeof(buffer), "%a %Y/%m/%d %H:%M:%S %Z (%z)", &datetime);
-      DEBUG_PRINTF("refreshed datetime: %s\n", buffer);
-#endif
-
-      struct tm end_datetime = {.tm_sec = 0, .tm_min = 0, .tm_hour = 0, .tm_mday = 1, .tm_mon = 0, .tm_year = 70, .tm_wday = 4, .tm_yday = 0, .tm_isdst = -1};
-      JsonArray end_date = jevent[F("ed")];
-      if (!end_date.isNull() && end_date.size() == 3) {
-        end_datetime.tm_year = (end_date[0].as<uint16_t>()) - 1900;
-        end_datetime.tm_mon = (end_date[1].as<uint8_t>()) - 1;
-        end_datetime.tm_mday = end_date[2].as<uint8_t>();
-      }
-      JsonArray end_time = jevent[F("et")];
-      if (!end_time.isNull() && (end_time.size() == 2 || end_time.size() == 3)) {
-        end_datetime.tm_hour = end_time[0].as<uint8_t>();
-        end_datetime.tm_min = end_time[1].as<uint8_t>();
-        end_datetime.tm_sec = end_time[2].as<uint8_t>();
-        if (end_time.size() == 2) {
-          // html time element on mobile may not allow setting seconds
-          end_datetime.tm_sec = 0;
-        }
-        if (end_time.size() == 3) {
-          end_datetime.tm_sec = event_time[2].as<uint8_t>();
-        }
-        end_datetime.tm_isdst = -1;
-      }
-
-      if (is_expired(datetime, end_datetime)) {
-        continue;
-      }
-
-
-      uint8_t exclude = 0;
-      if (!jevent[F("e")].isNull()) {
-        exclude = jevent[F("e")].as<uint8_t>();
-        DEBUG_PRINT("exclude: ");
-        DEBUG_PRINTLN(exclude);
-      }
-
-      uint8_t pattern = 0;
-      if (!jevent[F("p")].isNull()) {
-        pattern = jevent[F("p")].as<uint8_t>();
-      }
-
-      uint32_t color = 0x00FF0000;
-      if (!jevent[F("c")].isNull()) {
-        const char* cs = jevent[F("c")];
-        if (strlen(cs) == 10) {
-          color = strtoul(cs, NULL, 16);
-        }
-      }
-
-      const char* sound = "";
-      if (!jevent[F("s")].isNull()) {
-        sound = jevent[F("s")];
-      }
-
-      //for random sounds we wish the sound to be randomized every time the event occurrs, but
-      //also want the same sound to be replayed by single_click_handler()
-      //therefore when sound is "?????" we do not replace it directly with a random sound because
-      //the same random sound would be reused every time the event occurred.
-      //
-      //events json file does not actually have a field that directly correlates to is_random_sound
-      //when the file is loaded by this function, sound is used to set is_random_sound
-      //then when the event occurs is_random_sound is used to indicate that event.sound would be
-      //replaced with a random sound.
-      boolean is_random_sound = false;
-      if (strncmp(sound, RANDOM_SOUND_MARKER, strlen(RANDOM_SOUND_MARKER)*sizeof(char)) == 0) {
-        is_random_sound = true;
-      }
-
-      const char* voice = "";
-      if (!jevent[F("v")].isNull()) {
-        voice = jevent[F("v")];
-      }
-
-
-      struct Event event;
-      event.id = new_id(false);
-      DEBUG_PRINT("event.id: ");
-      DEBUG_PRINTLN(event.id);
-      event.datetime = datetime;
-      event.frequency = frequency;
-      event.end_datetime = end_datetime;
-      snprintf(event.description, sizeof(event.description), "%s", description);
-      event.exclude = exclude;
-      event.pattern = pattern;
-      event.color = color;
-      event.is_random_sound = is_random_sound;
-      snprintf(event.sound, sizeof(event.sound), "%s", sound);
-      snprintf(event.voice, sizeof(event.voice), "%s", voice);
-      event.timestamp = 0;
-      events.push_back(event);
-
-#if defined DEBUG_CONSOLE
-      // all of this is for outputting debugging info and is not required
-      struct tm local_now = {0};
-      time_t now;
-      time(&now);
-      localtime_r(&now, &local_now);
-      time_t tnow = mktime(&local_now);
-      time_t t2 = mktime(&datetime);
-      DEBUG_PRINT("seconds remaining: ");
-      DEBUG_PRINTLN(difftime(t2, tnow));
-
-      strftime(buffer, sizeof(buffer), "%a %Y/%m/%d %H:%M:%S %Z (%z)", &datetime);
-      DEBUG_PRINTF("event put on schedule: %s\n", buffer);
-      //strftime(buffer, sizeof(buffer), "%a %Y/%m/%d %H:%M:%S %Z (%z)", &local_now);
-      //DEBUG_PRINTF("local_now: %s\n\n", buffer);
-#endif
-    }
-  }
-  doc.clear(); // not sure if this is necessary.
-
-  return false;
-}
-
-
-bool save_file(String fs_path, String json, String& message) {
-  if (fs_path == "") {
-    if (message) {
-      message = F("save_file(): Filename is empty. Data not saved.");
-    }
-    return false;
-  }
-
-  //create_dirs(fs_path.substring(0, fs_path.lastIndexOf("/")+1));
-  File f = LittleFS.open(fs_path, "w");
-  if (f) {
-    //noInterrupts();
-    f.print(json);
-    delay(1);
-    f.close();
-    //interrupts();
-  }
-  else {
-    if (message) {
-      message = F("save_file(): Could not open file.");
-    }
-    return false;
-  }
-
-  if (message) {
-    message = F("save_file(): Data saved.");
-  }
-  return true;
-}
-
-
-void check_for_recent_events(uint16_t interval) {
-  static uint32_t pm = millis();
-  if ((millis() - pm) >= interval) {
-    pm = millis();
-    for (uint16_t i = 0; i < events.size(); i++) {
-      time_t now = 0;
-      struct tm local_now = {0};
-      time(&now);
-      localtime_r(&now, &local_now);
-
-      time_t tnow = mktime(&local_now);
-      time_t tevent = mktime(&events[i].datetime);
-
-      double dt = difftime(tevent, tnow); // seconds
-      const double happening_now_cutoff = (-6.0*EVENT_CHECK_INTERVAL)/1000; //30 seconds for 2000 millisecond check interval
-      if (happening_now_cutoff <= dt && dt <= 0) {
-        uint8_t mask = 1 << events[i].datetime.tm_wday;
-        if ((events[i].exclude & mask) == 0) {
-          events[i].timestamp = tevent;
-          struct AudioMessage audio_message = {events[i].id, "", "", "", events[i].timestamp, false};
-          snprintf(audio_message.description, sizeof(audio_message.description), "%s", events[i].description);
-
-          if (events[i].is_random_sound) {
-            // events[i].sound is overwritten because want single_click_handler()
-            // to be able to replay the same random song
-            set_random_sound(events[i].sound, sizeof(events[i].sound));
-          }
-          snprintf(audio_message.sound, sizeof(audio_message.sound), "%s", events[i].sound);
-
-          snprintf(audio_message.voice, sizeof(audio_message.voice), "%s", events[i].voice);
-          xQueueSend(qaudio_messages, (void *)&audio_message, 0);
-        }
-        // refresh_datetime() has the effect of moving the datetime away from the 
-        // happening now detection window which prevents multiple unneccessary detections
-        events[i].datetime = refresh_datetime(events[i].datetime, events[i].frequency);
-      }
-    }
-  }
-}
-
-
 void single_click_handler(Button2& b) {
   DEBUG_PRINTLN("single_click");
   if (mp3 && mp3->isRunning()) {
@@ -1412,12 +267,13 @@ void single_click_handler(Button2& b) {
       if (events[i].timestamp > 0) {
         struct AudioMessage audio_message;
         audio_message.id = events[i].id;
-        snprintf(audio_message.description, sizeof(audio_message.description), "%s", events[i].description);
-        snprintf(audio_message.sound, sizeof(audio_message.sound), "%s", events[i].sound);
-        snprintf(audio_message.voice, sizeof(audio_message.voice), "%s", events[i].voice);
+        snprintf(audio_message.description, sizeof(audio_message.description), "%s", event_description(events[i]));
+        snprintf(audio_message.sound, sizeof(audio_message.sound), "%s", event_sound(events[i]));
+        snprintf(audio_message.voice, sizeof(audio_message.voice), "%s", event_voice(events[i]));
         audio_message.timestamp = events[i].timestamp;
         audio_message.do_long_notify = true;
-        xQueueSend(qaudio_messages, (void *)&audio_message, 0);
+        audio_message.priority = events[i].priority;
+        queue_audio_message(audio_message);
       }
     }
   }
@@ -1428,9 +284,9 @@ void long_click_handler(Button2& b) {
   DEBUG_PRINTLN("long_click");
 
   for (uint16_t i = 0; i < events.size(); ) {
-    DEBUG_PRINTLN(events[i].description);
+    DEBUG_PRINTLN(event_description(events[i]));
     events[i].timestamp = 0;
-    if (is_expired(events[i].datetime, events[i].end_datetime)) {
+    if (is_expired(events[i].next_fire, events[i].rule)) {
       DEBUG_PRINTLN("expired event deleted.");
       events.erase(events.begin()+i);
     }
@@ -1439,14 +295,13 @@ void long_click_handler(Button2& b) {
       i++;
     }
   }
-  last_id_seen = SENTINEL_EVENT_ID;
+  notices_version++; // the render task clears the ring once post_visual_notices() posts that nothing is left
+  schedule_rebuild(); // indices in the schedule are no longer valid after erasing
 
   DEBUG_PRINTLN("after");
   for (uint16_t i = 0; i < events.size(); i++) {
-    DEBUG_PRINTLN(events[i].description);
+    DEBUG_PRINTLN(event_description(events[i]));
   }
-  FastLED.clear();
-  FastLED.show();
 }
 
 
@@ -1549,6 +404,75 @@ public:
 
 
 
+// runs in the esp_timer task when the soonest event is due
+void event_timer_callback(void* arg) {
+  events_due = true;
+  wake_loop();
+}
+
+
+// Button2 polls the pin, so the interrupt only wakes loop() to do the polling
+void IRAM_ATTR button_isr(void) {
+  button_changed_ms = millis();
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(loop_task, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+
+void wake_loop(void) {
+  if (loop_task != NULL) {
+    xTaskNotifyGive(loop_task);
+  }
+}
+
+
+// a one-shot timer for the soonest event, so it is checked on the second it is due instead of up to EVENT_CHECK_INTERVAL later.
+// loop() rearms it whenever the top of the schedule changes: events fired, edited, deleted, or reloaded.
+void arm_event_timer(void) {
+  event_timer_deadline = next_scheduled_fire();
+  if (event_timer == NULL) {
+    return;
+  }
+  esp_timer_stop(event_timer); // fails harmlessly if the timer already went off
+  if (event_timer_deadline == 0) {
+    return;
+  }
+  // the scheduler only sees whole seconds, but esp_timer does not count on the same clock as gettimeofday() and SNTP slews the latter.
+  // without the slack the timer can go off a hair before the second rolls over, find nothing due, and be rearmed for a few
+  // microseconds over and over. if it still goes off early, loop() rearms it for what is left instead.
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  int64_t wait_us = ((int64_t)event_timer_deadline - now.tv_sec)*1000000 - now.tv_usec;
+  esp_timer_start_once(event_timer, (wait_us > 0) ? wait_us + EVENT_TIMER_SLACK : 0);
+}
+
+
+// lets the CPU idle until the event timer, the button, or the web server needs loop().
+// espDelay() is not used because light sleep would drop the WiFi connection and the web server with it.
+// the wait is cut off after EVENT_CHECK_INTERVAL so WiFi drops and clock steps are still noticed.
+void idle_wait(void) {
+  if (dns_up || events_due || events_reload_needed || restart_needed || tz.unverified_iana_tz != "" || uxQueueMessagesWaiting(qevent_changes) > 0) {
+    return;
+  }
+  if (button.isPressed() || (millis() - button_changed_ms) < BUTTON_SETTLE_TIME) {
+    return;
+  }
+  uint32_t wait_ms = EVENT_CHECK_INTERVAL;
+  // the render task animates the notices on its own, loop() only has to post the next ones when they take turns
+  uint32_t turn_ms = ms_until_next_turn();
+  if (turn_ms == 0) {
+    return;
+  }
+  if (turn_ms < wait_ms) {
+    wait_ms = turn_ms;
+  }
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+}
+
+
 void espDelay(uint32_t ms) {
   esp_sleep_enable_timer_wakeup(ms * 1000);
   esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
@@ -1652,39 +576,7 @@ bool filterOnNotLocal(AsyncWebServerRequest *request) {
 
 
 void web_server_station_setup(void) {
-  web_server.on("/save", HTTP_POST, [](AsyncWebServerRequest *request) {
-    int rc = 400;
-    String message;
-
-    String id = request->getParam("id", true)->value();
-    String json = request->getParam("json", true)->value();
-
-    if (id != "") {
-      String fs_path = id;
-      if (id == USR_ROOT "/events.json" && save_file(fs_path, json, message)) {
-        events_reload_needed = true;
-        rc = 200;
-      }
-      if (id == USR_ROOT "/sound_URLs.json" && save_file(fs_path, json, message)) {
-        rc = 200;
-      }
-    }
-    else {
-      message = "Invalid type.";
-    }
-
-    request->send(rc, "application/json", "{\"message\": \""+message+"\"}");
-  });
-
-  web_server.on("/patterns.json", HTTP_GET, [](AsyncWebServerRequest *request) {
-    String out_json = "{\"patterns\":[" + patterns_json + ", {\"n\":\"?????\",\"v\":255}]}"; 
-    request->send(200, "application/json", out_json);
-  });
-
-  web_server.on("/special_colors.json", HTTP_GET, [](AsyncWebServerRequest *request) {
-    String out_json = "{\"special_colors\":[" + special_colors_json + ", {\"n\":\"?????\",\"v\":\"0xFFFFFFFF\"}]}"; 
-    request->send(200, "application/json", out_json);
-  });
+  web_api_setup(web_server);
 
   // files/ and www/ are both direct children of the littlefs root directory: /littlefs/files/ and /littlefs/www/
   // if the URL starts with /files/ then first look in /littlefs/files/ for the requested file
@@ -1747,6 +639,7 @@ void web_server_initiate(void) {
       AsyncWebParameter* p = request->getParam("iana_tz", true);
       if (!p->value().isEmpty()) {
         tz.unverified_iana_tz = p->value().c_str();
+        wake_loop();
       }
     }
     request->send(200);
@@ -2015,38 +908,38 @@ void DBG_create_test_data(tm local_now) {
 
   fill_in_datetime(&datetime);
 
+  uint8_t exclude = 0;
+  //uint8_t exclude = 32; // Friday
+  //uint8_t exclude = 95; // everyday but Friday
+  struct Recurrence rule = {0, 0, NO_OCCURRENCE, 0, frequency, 1, (uint8_t)(1 << datetime.tm_wday), exclude, 0};
+  rule.start_day = days_from_civil(datetime.tm_year + 1900, datetime.tm_mon + 1, datetime.tm_mday);
+  rule.time_of_day = datetime.tm_hour*3600 + datetime.tm_min*60 + datetime.tm_sec;
   if (frequency == 'w') {
-    datetime.tm_wday = 0;
+    rule.by_day = 1; // Sunday
   }
 
   char description[DESCRIPTION_SIZE] = "debug+test+1";
-  uint8_t exclude = 0;
-  //uint8_t exclude = 32; // Friday
-  //uint8_t exclude = 95; // everyday but Friday
   uint8_t pattern = 1;
   uint32_t color = 0x00FF0000; // solid red
   char sound[SOUND_SIZE] = ""; // no sound
   char voice[VOICE_SIZE] = "en-ca&v=Clara";
-  struct Event event1 = {new_id(false), refresh_datetime(datetime, frequency), frequency, {0}, "", exclude, pattern, color, "", false, "", 0};
-  event1.end_datetime = {.tm_sec = 0, .tm_min = 0, .tm_hour = 0, .tm_mday = 1, .tm_mon = 0, .tm_year = 70, .tm_wday = 4, .tm_yday = 0, .tm_isdst = -1};
-  snprintf(event1.description, sizeof(event1.description), "%s", description);
-  snprintf(event1.sound, sizeof(event1.sound), "%s", sound);
-  snprintf(event1.voice, sizeof(event1.voice), "%s", voice);
+  struct Event event1 = {0, 0, rule, color, add_event_string(description, DESCRIPTION_SIZE), new_id(false), intern_event_string(sound, SOUND_SIZE), intern_event_string(voice, VOICE_SIZE), pattern, 0, false}; // priority 0, the default
+  reschedule(event1);
   events.push_back(event1);
 
   datetime.tm_sec = local_now.tm_sec+25;
   fill_in_datetime(&datetime);
+  rule.start_day = days_from_civil(datetime.tm_year + 1900, datetime.tm_mon + 1, datetime.tm_mday);
+  rule.time_of_day = datetime.tm_hour*3600 + datetime.tm_min*60 + datetime.tm_sec;
   char description2[DESCRIPTION_SIZE] = "debug+test+2,+longer+description";
   pattern = 2;
   color = 0x01000000;
   char sound2[SOUND_SIZE] = "chime01.mp3";
   char voice2[VOICE_SIZE] = "en-ca&v=Clara";
-  struct Event event2 = {new_id(false), refresh_datetime(datetime, frequency), frequency, {0}, "", exclude, pattern, color, "", false, "", 0};
-  event2.end_datetime = {.tm_sec = 0, .tm_min = 0, .tm_hour = 0, .tm_mday = 1, .tm_mon = 0, .tm_year = 70, .tm_wday = 4, .tm_yday = 0, .tm_isdst = -1};
-  snprintf(event2.description, sizeof(event2.description), "%s", description2);
-  snprintf(event2.sound, sizeof(event2.sound), "%s", sound2);
-  snprintf(event2.voice, sizeof(event2.voice), "%s", voice2);
+  struct Event event2 = {0, 0, rule, color, add_event_string(description2, DESCRIPTION_SIZE), new_id(false), intern_event_string(sound2, SOUND_SIZE), intern_event_string(voice2, VOICE_SIZE), pattern, 0, false};
+  reschedule(event2);
   events.push_back(event2);
+  schedule_rebuild();
 }
 
 void setup() {
@@ -2078,8 +971,6 @@ void setup() {
   //So daylight saving starts on the second Sunday in March and finishes on the first Sunday in November. The switch occurs at 02:00 local time in both cases. This is the default switch time, so the /2 isn't strictly needed. 
   //
   preferences.begin("config", true);
-  NUM_LEDS = preferences.getUChar("num_leds", DEFAULT_NUM_LEDS);
-  LEDS_ORIGIN_OFFSET = preferences.getUChar("origin_offset", DEFAULT_LEDS_ORIGIN_OFFSET);
   tz.is_default_tz = false;
   tz.iana_tz = preferences.getString("iana_tz", "");
   tz.unverified_iana_tz = "";
@@ -2094,19 +985,8 @@ void setup() {
   }
   preferences.end();
 
-  leds = (CRGB*)malloc(NUM_LEDS*sizeof(CRGB));
-  // setMaxPowerInVoltsAndMilliamps() should not be used if homogenize_brightness_custom() is used
-  // since setMaxPowerInVoltsAndMilliamps() uses the builtin LED power usage constants 
-  // homogenize_brightness_custom() was created to avoid.
-  FastLED.setMaxPowerInVoltsAndMilliamps(LED_STRIP_VOLTAGE, LED_STRIP_MILLIAMPS);
-  FastLED.setCorrection(TypicalSMD5050);
-  FastLED.addLeds<WS2812B, DATA_PIN, COLOR_ORDER>(leds, NUM_LEDS);
-
-  FastLED.clear();
-  FastLED.show(); // clear the matrix on startup
-
-  homogenize_brightness();
-  FastLED.setBrightness(homogenized_brightness);
+  scheduler_setup();
+  renderer_setup();
 
   // DEBUG: helps to see when device has booted, possibly from a crash, and helps show that no events have occurred yet.
   //for (uint8_t i = 0; i < NUM_LEDS; i++) {
@@ -2136,13 +1016,18 @@ void setup() {
   random16_set_seed(8934); // taken from NoisePlayground.ino, not sure if this a particularly good seed
   random16_add_entropy(analogRead(34)); // ESP32 mini GPIO34 is an ADC
 
-  // once you are happy with your patterns list and special colors list you may want to hardcode them
-  // to patterns_json and special_colors_json instead of using these functions to generate the JSON strings
-  // at each boot.
-  while(!create_patterns_list());
-  while(!create_special_colors_list());
-
   button.begin(BUTTON_PIN);
+  loop_task = xTaskGetCurrentTaskHandle(); // setup() and loop() run in the same task
+  attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), button_isr, CHANGE);
+
+  esp_timer_create_args_t event_timer_args = {};
+  event_timer_args.callback = event_timer_callback;
+  event_timer_args.name = "events";
+  esp_timer_create(&event_timer_args, &event_timer);
+
+  // core 0 like aural_notifier(), parsing a big events file does not hold up loop() on core 1
+  TaskHandle_t Task2;
+  xTaskCreatePinnedToCore(events_loader, "Task2", 10000, NULL, 1, &Task2, 0);
 
   button.setLongClickTime(2000); // milliseconds
   button.setTapHandler(single_click_handler); // allows for a slower click which is better for a big button with more inertia
@@ -2182,6 +1067,12 @@ void setup() {
     FastLED.show();
   }
 
+  // anything drawn above stays up until there is a notice to show
+  TaskHandle_t Task3;
+  xTaskCreatePinnedToCore(led_output, "Task3", 10000, NULL, LED_OUTPUT_PRIORITY, &Task3, RENDER_TASK_CORE);
+  TaskHandle_t Task4;
+  xTaskCreatePinnedToCore(visual_notifier, "Task4", 10000, NULL, RENDER_TASK_PRIORITY, &Task4, RENDER_TASK_CORE);
+
   mdns_setup();
   web_server_initiate();
 
@@ -2220,6 +1111,8 @@ void setup() {
     TaskHandle_t Task1;
     xTaskCreatePinnedToCore(aural_notifier, "Task1", 10000, NULL, 1, &Task1, 0);
 
+    tz_table_rebuild(time(NULL)); // TZ was set by configTzTime() above and only changes with a restart
+    load_scheduler_watermark();
     load_events_file();
     //DBG_create_test_data(local_now);
     check_for_recent_events(0);
@@ -2239,15 +1132,28 @@ void loop() {
 
 
   button.loop();
+  if (events_due) {
+    events_due = false;
+    check_for_recent_events(0);
+    event_timer_deadline = 0; // rearm even if the soonest event did not change, the timer may have gone off early after a clock step
+  }
+  // the timer counts from when it was armed, so this catches events the clock stepped past
   check_for_recent_events(EVENT_CHECK_INTERVAL);
-  visual_notifier();
-  if (events_reload_needed) {
-    events_reload_needed = load_events_file();
-    FastLED.clear();
-    FastLED.show();
+  post_visual_notices();
+  apply_event_changes();
+  // the events are reloaded on events_loader()'s task, loop() keeps going with the old table until the new one is swapped in
+  if (events_reload_needed && start_events_reload()) {
+    events_reload_needed = false;
+  }
+  finish_events_reload();
+  refresh_upcoming();
+  if (next_scheduled_fire() != event_timer_deadline) {
+    arm_event_timer();
   }
 
   if (tz.unverified_iana_tz != "") {
     verify_timezone(tz.unverified_iana_tz);
   }
+
+  idle_wait();
 }
\ No newline at end of file
@@ -0,0 +1,19 @@
+// [env:native] stand-ins for the ESP8266Audio and I2S playback in main.cpp.
+// nothing is decoded or sent to a DAC, each call only reports what would have been played.
+
+#include "audio_queue.h"
+
+
+void http_sound(const char* url) {
+  DEBUG_PRINTF("http_sound(): %s\n", url);
+}
+
+
+void tell(const char* description, const char* voice, time_t timestamp, bool do_long_notify) {
+  DEBUG_PRINTF("tell(): %s (%s) %s\n", description, voice, do_long_notify ? "long" : "short");
+}
+
+
+void file_sound(const char* filename) {
+  DEBUG_PRINTF("file_sound(): %s\n", filename);
+}
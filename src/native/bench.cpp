@@ -0,0 +1,174 @@
+// [env:native] driver for profiling the firmware core on a Linux host.
+//
+// usage: program [all|load|refresh|visual] [iterations]
+//        program render [milliseconds]
+//        program replay [options], see replay.cpp
+// visual times render_notices() on its own with frames sent straight to the stand-in FastLED. render runs the render and output
+// tasks against a stand-in strip as slow as a real one while this thread stands in for a loop() that keeps getting stuck.
+// LITTLEFS_ROOT is the directory standing in for the flash filesystem (default: data), e.g.
+//   LITTLEFS_ROOT=data TZ=EST5EDT,M3.2.0,M11.1.0 .pio/build/native/program refresh 100000
+//   valgrind --tool=callgrind .pio/build/native/program load 50
+//   perf record -g .pio/build/native/program visual 1000000
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include <chrono>
+
+#include "config.h"
+#include "scheduler.h"
+#include "storage.h"
+#include "renderer.h"
+#include "replay.h"
+
+bool restart_needed = false;
+
+// the native driver calls check_for_recent_events() and apply_event_changes() itself, so there is no loop() to wake
+void wake_loop(void) {
+}
+
+
+static double elapsed_us(std::chrono::steady_clock::time_point start, uint32_t iterations) {
+  std::chrono::duration<double, std::micro> us = std::chrono::steady_clock::now() - start;
+  return us.count() / iterations;
+}
+
+
+// times parsing events.json and loading the binary snapshot made from it separately
+static void bench_load_events_file(uint32_t iterations) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < iterations; n++) {
+    LittleFS.remove(EVENTS_SNAPSHOT_PATH);
+    load_events_file();
+  }
+  printf("load_events_file():  %10.3f us/call  (%u events loaded from events.json and snapshot saved)\n", elapsed_us(start, iterations), (unsigned)events.size());
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < iterations; n++) {
+    load_events_file();
+  }
+  printf("load_events_file():  %10.3f us/call  (%u events loaded from snapshot)\n", elapsed_us(start, iterations), (unsigned)events.size());
+}
+
+
+static void bench_refresh_datetime(uint32_t iterations) {
+  if (events.empty()) {
+    printf("refresh_datetime():  skipped, no events loaded\n");
+    return;
+  }
+  time_t sum = 0; // keeps the calls from being optimized away
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < iterations; n++) {
+    sum += refresh_datetime(events[n % events.size()].rule);
+  }
+  printf("refresh_datetime():  %10.3f us/call  (checksum %lld)\n", elapsed_us(start, iterations), (long long)sum);
+}
+
+
+static void bench_render_notices(uint32_t iterations) {
+  if (events.empty()) {
+    printf("render_notices():    skipped, no events loaded\n");
+    return;
+  }
+  // every event needs a timestamp to be shown
+  for (uint16_t i = 0; i < events.size(); i++) {
+    events[i].timestamp = i + 1;
+  }
+  notices_version++;
+  post_visual_notices();
+  uint32_t shows = FastLED.getShowCount();
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < iterations; n++) {
+    post_visual_notices();
+    render_notices();
+  }
+  printf("render_notices():    %10.3f us/call  (%u frames, last frame checksum %08x, %u unchanged frames skipped, %u dropped, show() %u us max, "
+         "%u animation ticks caught up, %u lost)\n",
+         elapsed_us(start, iterations), (unsigned)(FastLED.getShowCount() - shows), (unsigned)FastLED.getFrameChecksum(),
+         (unsigned)render_stats.skipped, (unsigned)render_stats.dropped, (unsigned)render_stats.show_us_max,
+         (unsigned)render_stats.ticks_caught_up, (unsigned)render_stats.ticks_lost);
+  for (uint16_t i = 0; i < events.size(); i++) {
+    events[i].timestamp = 0;
+  }
+  notices_version++;
+  post_visual_notices();
+}
+
+
+// the tasks keep running afterwards, so this goes last
+static void bench_render_task(uint32_t ms) {
+  if (events.empty()) {
+    printf("visual_notifier():   skipped, no events loaded\n");
+    return;
+  }
+  for (uint16_t i = 0; i < events.size(); i++) {
+    events[i].timestamp = i + 1;
+  }
+  notices_version++;
+  render_stats = {0};
+  FastLED.setWireMicrosPerLed(30); // a WS2812B
+  uint32_t shows = FastLED.getShowCount();
+  xTaskCreatePinnedToCore(led_output, "Task3", 10000, NULL, LED_OUTPUT_PRIORITY, NULL, RENDER_TASK_CORE);
+  xTaskCreatePinnedToCore(visual_notifier, "Task4", 10000, NULL, RENDER_TASK_PRIORITY, NULL, RENDER_TASK_CORE);
+
+  // a pass of loop() every few milliseconds, and every quarter second one that is stuck for 200 ms, e.g. parsing events.json
+  uint32_t stalls = 0;
+  uint32_t start = millis();
+  while (millis() - start < ms) {
+    post_visual_notices();
+    if ((millis() - start)/250 > stalls) {
+      stalls++;
+      uint32_t stuck = millis();
+      while (millis() - stuck < 200);
+    }
+    delay(5);
+  }
+  struct RenderStats stats = render_stats;
+  printf("visual_notifier():   %u ms with loop() stuck %u times  (%u frames, %u sent, last frame checksum %08x, latest %u ms late, %u dropped, "
+         "%u held back for led_output(), render %u us max, show() %u us max)\n",
+         (unsigned)ms, (unsigned)stalls, (unsigned)stats.frames, (unsigned)(FastLED.getShowCount() - shows), (unsigned)FastLED.getFrameChecksum(),
+         (unsigned)stats.late_ms_max, (unsigned)stats.dropped, (unsigned)stats.output_busy, (unsigned)stats.render_us_max, (unsigned)stats.show_us_max);
+}
+
+
+int main(int argc, char* argv[]) {
+  const char* which = (argc > 1) ? argv[1] : "all";
+  uint32_t iterations = (argc > 2) ? strtoul(argv[2], NULL, 10) : 0;
+
+  if (!LittleFS.begin()) {
+    fprintf(stderr, "%s is not a directory. set LITTLEFS_ROOT to the directory holding files/usr/events.json\n", LittleFS.root().c_str());
+    return 1;
+  }
+  scheduler_setup();
+
+  if (strcmp(which, "replay") == 0) {
+    return replay_main(argc - 2, argv + 2);
+  }
+
+  if (getenv("TZ") == NULL) {
+    setenv("TZ", "EST5EDT,M3.2.0,M11.1.0", 1);
+  }
+  tzset();
+  tz_table_rebuild(time(NULL));
+
+  renderer_setup();
+
+  bool all = strcmp(which, "all") == 0;
+  if (all || strcmp(which, "load") == 0) {
+    bench_load_events_file(iterations ? iterations : 100);
+  }
+  else {
+    load_events_file();
+  }
+  if (all || strcmp(which, "refresh") == 0) {
+    bench_refresh_datetime(iterations ? iterations : 100000);
+  }
+  if (all || strcmp(which, "visual") == 0) {
+    bench_render_notices(iterations ? iterations : 100000);
+  }
+  if (all || strcmp(which, "render") == 0) {
+    bench_render_task(iterations ? iterations : 2000);
+  }
+
+  return restart_needed ? 2 : 0;
+}
@@ -0,0 +1,157 @@
+#include "Arduino.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+HardwareSerial Serial;
+
+static const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
+
+
+uint32_t millis(void) {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - boot).count();
+}
+
+
+uint32_t micros(void) {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot).count();
+}
+
+
+void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+
+void yield(void) {
+  std::this_thread::yield();
+}
+
+
+// seeded the same way every run so benchmarks draw the same twinkles and random sounds
+static std::mt19937 rng(1);
+
+long random(long howbig) {
+  if (howbig <= 0) {
+    return 0;
+  }
+  return rng() % howbig;
+}
+
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) {
+    return howsmall;
+  }
+  return howsmall + random(howbig - howsmall);
+}
+
+
+void randomSeed(unsigned long seed) {
+  rng.seed(seed);
+}
+
+
+struct NativeQueue {
+  size_t length;
+  size_t item_size;
+  std::deque<std::vector<uint8_t>> items;
+  std::mutex mutex;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+};
+
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  NativeQueue* queue = new NativeQueue;
+  queue->length = length;
+  queue->item_size = item_size;
+  return queue;
+}
+
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  auto has_room = [queue] { return queue->items.size() < queue->length; };
+  // a timed wait costs tens of microseconds even when it is 0, so only wait when asked to
+  if (!has_room() && (ticks_to_wait == 0 || !queue->not_full.wait_for(lock, std::chrono::milliseconds(ticks_to_wait), has_room))) {
+    return pdFALSE;
+  }
+  const uint8_t* p = (const uint8_t*)item;
+  queue->items.emplace_back(p, p + queue->item_size);
+  queue->not_empty.notify_one();
+  return pdTRUE;
+}
+
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticks_to_wait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  auto has_item = [queue] { return !queue->items.empty(); };
+  if (!has_item() && (ticks_to_wait == 0 || !queue->not_empty.wait_for(lock, std::chrono::milliseconds(ticks_to_wait), has_item))) {
+    return pdFALSE;
+  }
+  memcpy(buffer, queue->items.front().data(), queue->item_size);
+  queue->items.pop_front();
+  queue->not_full.notify_one();
+  return pdTRUE;
+}
+
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->items.size();
+}
+
+
+struct NativeSemaphore {
+  std::timed_mutex mutex;
+};
+
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+  return new NativeSemaphore;
+}
+
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+  if (ticks_to_wait == portMAX_DELAY) {
+    semaphore->mutex.lock();
+    return pdTRUE;
+  }
+  return semaphore->mutex.try_lock_for(std::chrono::milliseconds(ticks_to_wait)) ? pdTRUE : pdFALSE;
+}
+
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  semaphore->mutex.unlock();
+  return pdTRUE;
+}
+
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_depth, void* parameter, UBaseType_t priority, TaskHandle_t* handle) {
+  std::thread(task, parameter).detach();
+  if (handle) {
+    *handle = NULL;
+  }
+  return pdPASS;
+}
+
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack_depth, void* parameter, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  return xTaskCreate(task, name, stack_depth, parameter, priority, handle);
+}
+
+
+void vTaskDelay(TickType_t ticks) {
+  delay(ticks);
+}
+
+
+// tasks in this project never return from their loop, so there is nothing to clean up
+void vTaskDelete(TaskHandle_t handle) {
+}
@@ -0,0 +1,251 @@
+// host stand-in for the parts of the Arduino core and FreeRTOS used by the scheduler, storage, renderer, and audio queue.
+// only [env:native] puts src/native/hal on the include path, the ESP32 builds use the real Arduino.h.
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <ctype.h>
+#include <time.h>
+#include <string>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define F(s) (s)
+#define PROGMEM
+#define DEC 10
+#define HEX 16
+
+
+class String {
+  public:
+    String() {}
+    String(const char* s) : s_(s ? s : "") {}
+    String(const std::string& s) : s_(s) {}
+    String(char c) : s_(1, c) {}
+    String(int value) : s_(std::to_string(value)) {}
+    String(unsigned int value) : s_(std::to_string(value)) {}
+    String(long value) : s_(std::to_string(value)) {}
+    String(unsigned long value) : s_(std::to_string(value)) {}
+
+    const char* c_str() const { return s_.c_str(); }
+    unsigned int length() const { return s_.length(); }
+    // an Arduino String is always true unless it failed to allocate, which does not happen here
+    explicit operator bool() const { return true; }
+    char operator[](unsigned int index) const { return index < s_.length() ? s_[index] : 0; }
+
+    bool operator==(const String& rhs) const { return s_ == rhs.s_; }
+    bool operator==(const char* rhs) const { return s_ == (rhs ? rhs : ""); }
+    bool operator!=(const String& rhs) const { return s_ != rhs.s_; }
+    bool operator!=(const char* rhs) const { return !(*this == rhs); }
+    bool equals(const String& rhs) const { return s_ == rhs.s_; }
+
+    String& operator+=(const String& rhs) { s_ += rhs.s_; return *this; }
+    String& operator+=(const char* rhs) { s_ += (rhs ? rhs : ""); return *this; }
+    String& operator+=(char rhs) { s_ += rhs; return *this; }
+    bool concat(const char* s, size_t n) { s_.append(s, n); return true; }
+    bool concat(const String& rhs) { s_ += rhs.s_; return true; }
+    bool concat(char c) { s_ += c; return true; }
+    friend String operator+(const String& lhs, const String& rhs) { return String(lhs.s_ + rhs.s_); }
+    friend String operator+(const String& lhs, const char* rhs) { return String(lhs.s_ + (rhs ? rhs : "")); }
+    friend String operator+(const char* lhs, const String& rhs) { return String((lhs ? lhs : "") + rhs.s_); }
+
+    int indexOf(char c, unsigned int from = 0) const {
+      size_t i = s_.find(c, from);
+      return (i == std::string::npos) ? -1 : (int)i;
+    }
+    int indexOf(const String& str, unsigned int from = 0) const {
+      size_t i = s_.find(str.s_, from);
+      return (i == std::string::npos) ? -1 : (int)i;
+    }
+    int lastIndexOf(char c) const {
+      size_t i = s_.rfind(c);
+      return (i == std::string::npos) ? -1 : (int)i;
+    }
+    int lastIndexOf(const String& str) const {
+      size_t i = s_.rfind(str.s_);
+      return (i == std::string::npos) ? -1 : (int)i;
+    }
+    String substring(unsigned int from) const { return from < s_.length() ? String(s_.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+      if (from > to) std::swap(from, to);
+      if (from >= s_.length()) return String();
+      return String(s_.substr(from, to - from));
+    }
+    bool startsWith(const String& prefix) const { return s_.compare(0, prefix.s_.length(), prefix.s_) == 0; }
+    bool endsWith(const String& suffix) const {
+      return s_.length() >= suffix.s_.length() && s_.compare(s_.length() - suffix.s_.length(), suffix.s_.length(), suffix.s_) == 0;
+    }
+    long toInt() const { return strtol(s_.c_str(), NULL, 10); }
+    void reserve(unsigned int size) { s_.reserve(size); }
+    void trim() {
+      size_t b = s_.find_first_not_of(" \t\r\n");
+      size_t e = s_.find_last_not_of(" \t\r\n");
+      s_ = (b == std::string::npos) ? "" : s_.substr(b, e - b + 1);
+    }
+
+  private:
+    std::string s_;
+};
+
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+      size_t n = 0;
+      while (size--) {
+        n += write(*buffer++);
+      }
+      return n;
+    }
+    size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(long n, int base = DEC) { return printf(base == HEX ? "%lX" : "%ld", n); }
+    size_t print(unsigned long n, int base = DEC) { return printf(base == HEX ? "%lX" : "%lu", n); }
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(double n) { return printf("%.2f", n); }
+    size_t println(void) { return write("\r\n"); }
+    template <typename T> size_t println(const T& value) { return print(value) + println(); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+      char buffer[256];
+      va_list args;
+      va_start(args, format);
+      int len = vsnprintf(buffer, sizeof(buffer), format, args);
+      va_end(args);
+      if (len < 0) {
+        return 0;
+      }
+      if ((size_t)len < sizeof(buffer)) {
+        return write((const uint8_t*)buffer, len);
+      }
+      std::string big(len + 1, '\0');
+      va_start(args, format);
+      vsnprintf(&big[0], big.size(), format, args);
+      va_end(args);
+      return write((const uint8_t*)big.c_str(), len);
+    }
+    virtual void flush() {}
+};
+
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t readBytes(char* buffer, size_t length) {
+      size_t count = 0;
+      while (count < length) {
+        int c = read();
+        if (c < 0) {
+          break;
+        }
+        *buffer++ = (char)c;
+        count++;
+      }
+      return count;
+    }
+    void setTimeout(unsigned long) {}
+
+    String readStringUntil(char terminator) {
+      std::string s;
+      int c;
+      while ((c = read()) >= 0 && c != terminator) {
+        s += (char)c;
+      }
+      return String(s);
+    }
+
+    // reads until target is found. there is nothing to wait for on the host, so reaching the end of the stream is a timeout.
+    bool find(const char* target) { return findUntil(target, NULL); }
+    bool findUntil(const char* target, const char* terminator) {
+      size_t t_len = strlen(target);
+      size_t term_len = terminator ? strlen(terminator) : 0;
+      size_t t_index = 0;
+      size_t term_index = 0;
+      int c;
+      while ((c = read()) >= 0) {
+        t_index = (c == target[t_index]) ? t_index + 1 : (c == target[0]) ? 1 : 0;
+        if (t_index == t_len) {
+          return true;
+        }
+        if (term_len > 0) {
+          term_index = (c == terminator[term_index]) ? term_index + 1 : (c == terminator[0]) ? 1 : 0;
+          if (term_index == term_len) {
+            return false;
+          }
+        }
+      }
+      return false;
+    }
+};
+
+
+// writes to stdout so debugging output can still be enabled on the host by leaving DISABLE_DEBUG_CONSOLE undefined
+class HardwareSerial : public Stream {
+  public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+    size_t write(const uint8_t* buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void flush() override { fflush(stdout); }
+};
+
+extern HardwareSerial Serial;
+
+
+// the clock. millis() and micros() count from the first call the same way they count from boot on the ESP32.
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(uint32_t ms);
+void yield(void);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+
+// FreeRTOS queues and tasks backed by std::thread, just enough for aural_notifier() and qaudio_messages
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef struct NativeQueue* QueueHandle_t;
+typedef struct NativeSemaphore* SemaphoreHandle_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define portMAX_DELAY 0xFFFFFFFF
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticks_to_wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_depth, void* parameter, UBaseType_t priority, TaskHandle_t* handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack_depth, void* parameter, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t handle);
+
+#endif
@@ -0,0 +1,141 @@
+// host stand-in for ESPAsyncWebServer. nothing listens on a socket,
+// requests are built by the native driver and passed to AsyncWebServer::handle() which calls the matching handler.
+
+#ifndef NATIVE_ESPASYNCWEBSERVER_H
+#define NATIVE_ESPASYNCWEBSERVER_H
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+typedef enum {
+  HTTP_GET     = 0b00000001,
+  HTTP_POST    = 0b00000010,
+  HTTP_DELETE  = 0b00000100,
+  HTTP_PUT     = 0b00001000,
+  HTTP_PATCH   = 0b00010000,
+  HTTP_HEAD    = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY     = 0b01111111,
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+
+class AsyncWebParameter {
+  public:
+    AsyncWebParameter(const String& name, const String& value, bool form = false) : name_(name), value_(value), form_(form) {}
+    const String& name() const { return name_; }
+    const String& value() const { return value_; }
+    bool isPost() const { return form_; }
+
+  private:
+    String name_;
+    String value_;
+    bool form_;
+};
+
+
+class AsyncWebServerResponse {
+  public:
+    virtual ~AsyncWebServerResponse() {}
+    int code = 200;
+    String content_type;
+    String content;
+};
+
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print {
+  public:
+    size_t write(uint8_t c) override { content += (char)c; return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { content.concat((const char*)buffer, size); return size; }
+    using Print::write;
+};
+
+
+class AsyncWebServerRequest {
+  public:
+    AsyncWebServerRequest(WebRequestMethod method, const String& url) : method_(method), url_(url) {}
+    ~AsyncWebServerRequest() { delete response_; }
+
+    // only in the stand-in. used by the native driver to fill in the request.
+    void addParam(const String& name, const String& value, bool post = false) { params_.emplace_back(name, value, post); }
+
+    WebRequestMethod method() const { return method_; }
+    const String& url() const { return url_; }
+
+    size_t params() const { return params_.size(); }
+    AsyncWebParameter* getParam(size_t num) { return num < params_.size() ? &params_[num] : nullptr; }
+    AsyncWebParameter* getParam(const String& name, bool post = false) {
+      for (AsyncWebParameter& p : params_) {
+        if (p.name() == name && p.isPost() == post) {
+          return &p;
+        }
+      }
+      return nullptr;
+    }
+    bool hasParam(const String& name, bool post = false) { return getParam(name, post) != nullptr; }
+
+    void send(int code, const String& content_type = String(), const String& content = String()) {
+      AsyncWebServerResponse* response = new AsyncWebServerResponse;
+      response->code = code;
+      response->content_type = content_type;
+      response->content = content;
+      send(response);
+    }
+    // content is in flash on the ESP32, there is no difference on the host
+    void send_P(int code, const String& content_type, const char* content) { send(code, content_type, String(content)); }
+    void send(AsyncWebServerResponse* response) {
+      delete response_;
+      response_ = response;
+    }
+    AsyncResponseStream* beginResponseStream(const String& content_type, size_t buffer_size = 1460) {
+      AsyncResponseStream* response = new AsyncResponseStream;
+      response->content_type = content_type;
+      return response;
+    }
+
+    // only in the stand-in. what the handler sent, or nullptr if it did not respond.
+    const AsyncWebServerResponse* response() const { return response_; }
+
+  private:
+    WebRequestMethod method_;
+    String url_;
+    std::vector<AsyncWebParameter> params_;
+    AsyncWebServerResponse* response_ = nullptr;
+};
+
+
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+
+
+class AsyncWebServer {
+  public:
+    explicit AsyncWebServer(uint16_t port) {}
+    void begin(void) {}
+    void on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction on_request) {
+      handlers_.push_back({String(uri), method, on_request});
+    }
+
+    // only in the stand-in. calls the first handler registered for the request's url and method.
+    // returns false and responds with 404 if there is none, the same as the real server with no onNotFound() handler.
+    bool handle(AsyncWebServerRequest* request) {
+      for (const Handler& h : handlers_) {
+        if (h.uri == request->url() && (h.method & request->method())) {
+          h.on_request(request);
+          return true;
+        }
+      }
+      request->send(404);
+      return false;
+    }
+
+  private:
+    struct Handler {
+      String uri;
+      WebRequestMethodComposite method;
+      ArRequestHandlerFunction on_request;
+    };
+    std::vector<Handler> handlers_;
+};
+
+#endif
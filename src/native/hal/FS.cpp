@@ -0,0 +1,75 @@
+#include "FS.h"
+#include "LittleFS.h"
+
+#include <sys/stat.h>
+#include <errno.h>
+
+fs::LittleFSFS LittleFS;
+
+namespace fs {
+
+// LittleFS creates missing directories when a file is opened for writing, so this does too
+static bool make_dirs(const String& host_path) {
+  int slash = host_path.lastIndexOf('/');
+  if (slash <= 0) {
+    return true;
+  }
+  String dir = host_path.substring(0, slash);
+  struct stat st;
+  if (stat(dir.c_str(), &st) == 0) {
+    return S_ISDIR(st.st_mode);
+  }
+  if (!make_dirs(dir)) {
+    return false;
+  }
+  return ::mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+
+File FS::open(const String& path, const char* mode) {
+  String hp = host_path(path);
+  const char* host_mode = "rb";
+  if (mode[0] == 'w') {
+    make_dirs(hp);
+    host_mode = "wb";
+  }
+  else if (mode[0] == 'a') {
+    make_dirs(hp);
+    host_mode = "ab";
+  }
+  FILE* f = fopen(hp.c_str(), host_mode);
+  if (f == NULL) {
+    return File();
+  }
+  return File(f, path);
+}
+
+
+bool FS::exists(const String& path) {
+  struct stat st;
+  return stat(host_path(path).c_str(), &st) == 0;
+}
+
+
+bool FS::remove(const String& path) {
+  return ::remove(host_path(path).c_str()) == 0;
+}
+
+
+bool FS::rename(const String& from, const String& to) {
+  return ::rename(host_path(from).c_str(), host_path(to).c_str()) == 0;
+}
+
+
+bool FS::mkdir(const String& path) {
+  String hp = host_path(path) + "/";
+  return make_dirs(hp);
+}
+
+
+bool LittleFSFS::begin(bool format_on_fail, const char* base_path, uint8_t max_open_files, const char* partition_label) {
+  struct stat st;
+  return stat(root().c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+}
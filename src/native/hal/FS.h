@@ -0,0 +1,86 @@
+// host stand-in for the ESP32 fs::File and fs::FS classes. files are ordinary files under a directory on the host.
+
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+#include <Arduino.h>
+#include <memory>
+
+namespace fs {
+
+class File : public Stream {
+  public:
+    File() {}
+    explicit File(FILE* f, const String& path) : f_(f, fclose), path_(path) {}
+
+    explicit operator bool() const { return (bool)f_; }
+
+    size_t write(uint8_t c) override { return f_ ? fwrite(&c, 1, 1, f_.get()) : 0; }
+    size_t write(const uint8_t* buffer, size_t size) override { return f_ ? fwrite(buffer, 1, size, f_.get()) : 0; }
+    using Print::write;
+
+    int available() override {
+      if (!f_) return 0;
+      long pos = ftell(f_.get());
+      return (pos < 0) ? 0 : (int)(size() - pos);
+    }
+    int read() override { return f_ ? fgetc(f_.get()) : -1; }
+    int peek() override {
+      if (!f_) return -1;
+      int c = fgetc(f_.get());
+      if (c != EOF) ungetc(c, f_.get());
+      return c;
+    }
+    size_t readBytes(char* buffer, size_t length) override { return f_ ? fread(buffer, 1, length, f_.get()) : 0; }
+    size_t read(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+
+    bool seek(uint32_t pos) { return f_ && fseek(f_.get(), pos, SEEK_SET) == 0; }
+    size_t position() const { return f_ ? ftell(f_.get()) : 0; }
+    size_t size() const {
+      if (!f_) return 0;
+      long pos = ftell(f_.get());
+      fseek(f_.get(), 0, SEEK_END);
+      long end = ftell(f_.get());
+      fseek(f_.get(), pos, SEEK_SET);
+      return (end < 0) ? 0 : end;
+    }
+    const char* path() const { return path_.c_str(); }
+    void flush() override { if (f_) fflush(f_.get()); }
+    void close() { f_.reset(); }
+
+  private:
+    std::shared_ptr<FILE> f_;
+    String path_;
+};
+
+
+class FS {
+  public:
+    explicit FS(const char* default_root) : default_root_(default_root) {}
+
+    // the directory standing in for the flash partition. set LITTLEFS_ROOT to use something other than the data directory.
+    String root(void) const {
+      const char* env = getenv("LITTLEFS_ROOT");
+      return String(env ? env : default_root_);
+    }
+    String host_path(const String& path) const { return root() + path; }
+
+    File open(const String& path, const char* mode = "r");
+    File open(const char* path, const char* mode = "r") { return open(String(path), mode); }
+    bool exists(const String& path);
+    bool exists(const char* path) { return exists(String(path)); }
+    bool remove(const String& path);
+    bool remove(const char* path) { return remove(String(path)); }
+    bool rename(const String& from, const String& to);
+    bool mkdir(const String& path);
+
+  private:
+    const char* default_root_;
+};
+
+}
+
+using fs::FS;
+using fs::File;
+
+#endif
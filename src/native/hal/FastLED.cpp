@@ -0,0 +1,140 @@
+#include "FastLED.h"
+
+#include <chrono>
+#include <thread>
+
+CFastLED FastLED;
+
+// same per channel power use as FastLED's power_mgt.cpp
+static const uint8_t red_mW = 16 * 5;
+static const uint8_t green_mW = 11 * 5;
+static const uint8_t blue_mW = 15 * 5;
+static const uint8_t dark_mW = 1 * 5;
+
+
+// plain six sector conversion. FastLED's hsv2rgb_rainbow() spends more of the hue wheel on yellow but the cost is similar.
+CRGB::CRGB(const CHSV& hsv) {
+  uint8_t region = hsv.h / 43;
+  uint8_t remainder = (hsv.h - (region * 43)) * 6;
+  uint8_t p = scale8(hsv.v, 255 - hsv.s);
+  uint8_t q = scale8(hsv.v, 255 - scale8(hsv.s, remainder));
+  uint8_t t = scale8(hsv.v, 255 - scale8(hsv.s, 255 - remainder));
+  switch (region) {
+    case 0: r = hsv.v; g = t; b = p; break;
+    case 1: r = q; g = hsv.v; b = p; break;
+    case 2: r = p; g = hsv.v; b = t; break;
+    case 3: r = p; g = q; b = hsv.v; break;
+    case 4: r = t; g = p; b = hsv.v; break;
+    default: r = hsv.v; g = p; b = q; break;
+  }
+}
+
+
+CRGB blend(const CRGB& p1, const CRGB& p2, fract8 amount_of_p2) {
+  CRGB out;
+  for (uint8_t i = 0; i < 3; i++) {
+    out.raw[i] = scale8(p1.raw[i], 255 - amount_of_p2) + scale8(p2.raw[i], amount_of_p2);
+  }
+  return out;
+}
+
+
+CRGB ColorFromPalette(const CRGBPalette16& pal, uint8_t index, uint8_t brightness, TBlendType blend_type) {
+  uint8_t hi4 = index >> 4;
+  uint8_t lo4 = index & 0x0F;
+  CRGB color = pal[hi4];
+  if (lo4 && blend_type != NOBLEND) {
+    const CRGB& next = pal[(hi4 + 1) & 0x0F];
+    color = blend(color, next, lo4 << 4);
+  }
+  if (brightness != 255) {
+    color.nscale8(brightness);
+  }
+  return color;
+}
+
+
+void fill_solid(CRGB* leds, int num_leds, const CRGB& color) {
+  for (int i = 0; i < num_leds; i++) {
+    leds[i] = color;
+  }
+}
+
+
+void fill_rainbow_circular(CRGB* leds, int num_leds, uint8_t initialhue, bool reversed) {
+  if (num_leds == 0) {
+    return;
+  }
+  const uint16_t hue_change = 65535 / (uint16_t)num_leds;
+  uint16_t hue16 = (uint16_t)initialhue << 8;
+  for (int i = 0; i < num_leds; i++) {
+    leds[i] = CHSV(hue16 >> 8, 240, 255);
+    hue16 = reversed ? hue16 - hue_change : hue16 + hue_change;
+  }
+}
+
+
+uint32_t calculate_unscaled_power_mW(const CRGB* ledbuffer, uint16_t num_leds) {
+  uint32_t red32 = 0, green32 = 0, blue32 = 0;
+  for (uint16_t i = 0; i < num_leds; i++) {
+    red32 += ledbuffer[i].r;
+    green32 += ledbuffer[i].g;
+    blue32 += ledbuffer[i].b;
+  }
+  red32 = (red32 * red_mW) >> 8;
+  green32 = (green32 * green_mW) >> 8;
+  blue32 = (blue32 * blue_mW) >> 8;
+  return red32 + green32 + blue32 + (uint32_t)dark_mW * num_leds;
+}
+
+
+uint8_t calculate_max_brightness_for_power_mW(const CRGB* ledbuffer, uint16_t num_leds, uint8_t target_brightness, uint32_t max_power_mW) {
+  uint32_t total_mW = calculate_unscaled_power_mW(ledbuffer, num_leds);
+  uint32_t requested_power_mW = (total_mW * target_brightness) / 256;
+  if (requested_power_mW <= max_power_mW) {
+    return target_brightness;
+  }
+  return (uint8_t)(((uint32_t)target_brightness * max_power_mW) / requested_power_mW);
+}
+
+
+uint8_t calculate_max_brightness_for_power_vmA(const CRGB* ledbuffer, uint16_t num_leds, uint8_t target_brightness, uint32_t max_power_V, uint32_t max_power_mA) {
+  return calculate_max_brightness_for_power_mW(ledbuffer, num_leds, target_brightness, max_power_V * max_power_mA);
+}
+
+
+void CFastLED::clear(bool write_data) {
+  if (controller_.leds_) {
+    fill_solid(controller_.leds_, controller_.num_leds_, CRGB::Black);
+  }
+  if (write_data) {
+    show();
+  }
+}
+
+
+// does the same per pixel work as FastLED's show(): limit the power, then scale and color correct every pixel.
+// the result goes into a running checksum instead of out the data pin.
+void CFastLED::show(void) {
+  show_count_++;
+  const CRGB* leds = controller_.leds_;
+  const int num_leds = controller_.num_leds_;
+  if (leds == nullptr) {
+    return;
+  }
+  uint8_t brightness = brightness_;
+  if (max_power_mW_ != 0xFFFFFFFF) {
+    brightness = calculate_max_brightness_for_power_mW(leds, num_leds, brightness_, max_power_mW_);
+  }
+  uint32_t checksum = 0;
+  for (int i = 0; i < num_leds; i++) {
+    for (uint8_t c = 0; c < 3; c++) {
+      uint8_t out = scale8_video(scale8(leds[i].raw[c], correction_.raw[c]), brightness);
+      checksum = (checksum * 31) + out;
+    }
+  }
+  frame_checksum_ = checksum;
+  if (wire_us_per_led_ > 0) {
+    std::this_thread::sleep_for(std::chrono::microseconds(wire_us_per_led_*num_leds));
+  }
+}
@@ -0,0 +1,176 @@
+// host stand-in for the parts of FastLED 3.6.0 used by the renderer.
+// the math follows FastLED closely enough that power limiting and patterns draw the same values,
+// and FastLED.show() is the LED sink: it counts frames and checksums what would have been sent to the strip.
+// setWireMicrosPerLed() makes show() take as long as writing a real strip, so the render task can be checked against a slow sink.
+
+#ifndef NATIVE_FASTLED_H
+#define NATIVE_FASTLED_H
+
+#include <Arduino.h>
+
+typedef uint8_t fract8;
+
+enum EOrder { RGB = 0012, RBG = 0021, GRB = 0102, GBR = 0120, BRG = 0201, BGR = 0210 };
+enum LEDColorCorrection { TypicalSMD5050 = 0xFFB0F0, TypicalLEDStrip = 0xFFB0F0, UncorrectedColor = 0xFFFFFF };
+enum TBlendType { NOBLEND = 0, LINEARBLEND = 1 };
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER> class WS2812B {};
+
+
+inline uint8_t scale8(uint8_t i, fract8 scale) {
+  return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8;
+}
+
+
+inline uint8_t scale8_video(uint8_t i, fract8 scale) {
+  return (((int)i * (int)scale) >> 8) + ((i && scale) ? 1 : 0);
+}
+
+
+inline uint8_t qsub8(uint8_t i, uint8_t j) {
+  int t = i - j;
+  return (t < 0) ? 0 : t;
+}
+
+
+inline uint8_t triwave8(uint8_t in) {
+  if (in & 0x80) {
+    in = 255 - in;
+  }
+  return in << 1;
+}
+
+
+inline uint8_t random8(void) {
+  return (uint8_t)random(256);
+}
+
+
+struct CHSV {
+  uint8_t h, s, v;
+  CHSV() : h(0), s(0), v(0) {}
+  CHSV(uint8_t ih, uint8_t is, uint8_t iv) : h(ih), s(is), v(iv) {}
+};
+
+
+struct CRGB {
+  union {
+    struct {
+      uint8_t r;
+      uint8_t g;
+      uint8_t b;
+    };
+    uint8_t raw[3];
+  };
+
+  typedef enum {
+    Black = 0x000000,
+    Blue = 0x0000FF,
+    Green = 0x008000,
+    Orange = 0xFFA500,
+    Pink = 0xFFC0CB,
+    Purple = 0x800080,
+    Red = 0xFF0000,
+    White = 0xFFFFFF,
+    Yellow = 0xFFFF00
+  } HTMLColorCode;
+
+  CRGB() : r(0), g(0), b(0) {}
+  CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+  CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+  CRGB(HTMLColorCode colorcode) : CRGB((uint32_t)colorcode) {}
+  CRGB(const CHSV& hsv);
+
+  uint8_t& operator[](uint8_t x) { return raw[x]; }
+  const uint8_t& operator[](uint8_t x) const { return raw[x]; }
+
+  CRGB& nscale8(uint8_t scaledown) {
+    r = scale8(r, scaledown);
+    g = scale8(g, scaledown);
+    b = scale8(b, scaledown);
+    return *this;
+  }
+
+  explicit operator uint32_t() const {
+    return 0xFF000000 | ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+  }
+};
+
+
+inline CRGB operator-(const CRGB& p1, const CRGB& p2) {
+  return CRGB(qsub8(p1.r, p2.r), qsub8(p1.g, p2.g), qsub8(p1.b, p2.b));
+}
+
+
+inline bool operator==(const CRGB& lhs, const CRGB& rhs) {
+  return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b;
+}
+
+
+class CRGBPalette16 {
+  public:
+    CRGB entries[16];
+    CRGB& operator[](uint8_t x) { return entries[x]; }
+    const CRGB& operator[](uint8_t x) const { return entries[x]; }
+};
+
+
+CRGB blend(const CRGB& p1, const CRGB& p2, fract8 amount_of_p2);
+CRGB ColorFromPalette(const CRGBPalette16& pal, uint8_t index, uint8_t brightness = 255, TBlendType blend_type = LINEARBLEND);
+void fill_solid(CRGB* leds, int num_leds, const CRGB& color);
+void fill_rainbow_circular(CRGB* leds, int num_leds, uint8_t initialhue, bool reversed = false);
+uint32_t calculate_unscaled_power_mW(const CRGB* ledbuffer, uint16_t num_leds);
+uint8_t calculate_max_brightness_for_power_mW(const CRGB* ledbuffer, uint16_t num_leds, uint8_t target_brightness, uint32_t max_power_mW);
+uint8_t calculate_max_brightness_for_power_vmA(const CRGB* ledbuffer, uint16_t num_leds, uint8_t target_brightness, uint32_t max_power_V, uint32_t max_power_mA);
+
+
+class CLEDController {
+  public:
+    CLEDController& setLeds(CRGB* data, int num_leds) {
+      leds_ = data;
+      num_leds_ = num_leds;
+      return *this;
+    }
+
+  private:
+    friend class CFastLED;
+    CRGB* leds_ = nullptr;
+    int num_leds_ = 0;
+};
+
+
+class CFastLED {
+  public:
+    template <template <uint8_t DATA_PIN, EOrder RGB_ORDER> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+    CLEDController& addLeds(CRGB* data, int num_leds) {
+      return controller_.setLeds(data, num_leds);
+    }
+
+    // there is only ever one strip
+    CLEDController& operator[](int x) { return controller_; }
+
+    void setBrightness(uint8_t scale) { brightness_ = scale; }
+    uint8_t getBrightness(void) const { return brightness_; }
+    void setCorrection(LEDColorCorrection correction) { correction_ = CRGB((uint32_t)correction); }
+    void setMaxPowerInVoltsAndMilliamps(uint8_t volts, uint32_t milliamps) { max_power_mW_ = volts * milliamps; }
+    void clear(bool write_data = false);
+    void show(void);
+
+    // only in the stand-in. lets the native driver check what was drawn without real LEDs.
+    uint32_t getShowCount(void) const { return show_count_; }
+    uint32_t getFrameChecksum(void) const { return frame_checksum_; }
+    void setWireMicrosPerLed(uint32_t us) { wire_us_per_led_ = us; }
+
+  private:
+    CLEDController controller_;
+    uint32_t wire_us_per_led_ = 0;
+    uint8_t brightness_ = 255;
+    CRGB correction_ = CRGB(0xFFFFFF);
+    uint32_t max_power_mW_ = 0xFFFFFFFF;
+    uint32_t show_count_ = 0;
+    uint32_t frame_checksum_ = 0;
+};
+
+extern CFastLED FastLED;
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef NATIVE_LITTLEFS_H
+#define NATIVE_LITTLEFS_H
+
+#include <FS.h>
+
+namespace fs {
+
+class LittleFSFS : public FS {
+  public:
+    LittleFSFS() : FS("data") {}
+    bool begin(bool format_on_fail = false, const char* base_path = "/littlefs", uint8_t max_open_files = 10, const char* partition_label = "spiffs");
+    void end(void) {}
+    size_t totalBytes(void) { return 0x29B000; } // size of the spiffs partition in partitions_custom.csv
+    size_t usedBytes(void) { return 0; }
+};
+
+}
+
+extern fs::LittleFSFS LittleFS;
+
+#endif
@@ -0,0 +1,95 @@
+#include "Preferences.h"
+
+#include <map>
+#include <mutex>
+
+// every Preferences object shares one store the same way they share the NVS partition on the ESP32
+static std::map<std::string, std::string> store;
+static std::mutex store_mutex;
+
+
+bool Preferences::begin(const char* name, bool read_only, const char* partition_label) {
+  name_ = name;
+  read_only_ = read_only;
+  started_ = true;
+  return true;
+}
+
+
+void Preferences::end(void) {
+  started_ = false;
+}
+
+
+bool Preferences::clear(void) {
+  if (!started_ || read_only_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(store_mutex);
+  std::string prefix = name_ + "/";
+  for (auto it = store.begin(); it != store.end();) {
+    it = (it->first.compare(0, prefix.size(), prefix) == 0) ? store.erase(it) : std::next(it);
+  }
+  return true;
+}
+
+
+bool Preferences::remove(const char* key) {
+  if (!started_ || read_only_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(store_mutex);
+  return store.erase(name_ + "/" + key) > 0;
+}
+
+
+bool Preferences::isKey(const char* key) {
+  std::string value;
+  return get(key, value);
+}
+
+
+String Preferences::getString(const char* key, const String default_value) {
+  std::string value;
+  return get(key, value) ? String(value) : default_value;
+}
+
+
+size_t Preferences::getBytesLength(const char* key) {
+  std::string value;
+  return get(key, value) ? value.size() : 0;
+}
+
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t max_len) {
+  std::string value;
+  if (!get(key, value) || value.size() > max_len) {
+    return 0;
+  }
+  memcpy(buffer, value.data(), value.size());
+  return value.size();
+}
+
+
+bool Preferences::put(const char* key, const std::string& value) {
+  if (!started_ || read_only_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(store_mutex);
+  store[name_ + "/" + key] = value;
+  return true;
+}
+
+
+bool Preferences::get(const char* key, std::string& value) {
+  if (!started_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(store_mutex);
+  auto it = store.find(name_ + "/" + key);
+  if (it == store.end()) {
+    return false;
+  }
+  value = it->second;
+  return true;
+}
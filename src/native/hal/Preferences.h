@@ -0,0 +1,49 @@
+// host stand-in for the ESP32 NVS Preferences library. values only live as long as the process.
+
+#ifndef NATIVE_PREFERENCES_H
+#define NATIVE_PREFERENCES_H
+
+#include <Arduino.h>
+
+class Preferences {
+  public:
+    bool begin(const char* name, bool read_only = false, const char* partition_label = NULL);
+    void end(void);
+    bool clear(void);
+    bool remove(const char* key);
+    bool isKey(const char* key);
+
+    size_t putUChar(const char* key, uint8_t value) { return put(key, std::to_string(value)) ? 1 : 0; }
+    size_t putUShort(const char* key, uint16_t value) { return put(key, std::to_string(value)) ? 2 : 0; }
+    size_t putUInt(const char* key, uint32_t value) { return put(key, std::to_string(value)) ? 4 : 0; }
+    size_t putInt(const char* key, int32_t value) { return put(key, std::to_string(value)) ? 4 : 0; }
+    size_t putLong64(const char* key, int64_t value) { return put(key, std::to_string(value)) ? 8 : 0; }
+    size_t putBool(const char* key, bool value) { return put(key, value ? "1" : "0") ? 1 : 0; }
+    size_t putString(const char* key, const char* value) { return put(key, value) ? strlen(value) : 0; }
+    size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+    size_t putBytes(const char* key, const void* value, size_t len) { return put(key, std::string((const char*)value, len)) ? len : 0; }
+
+    uint8_t getUChar(const char* key, uint8_t default_value = 0) { return get_number(key, default_value); }
+    uint16_t getUShort(const char* key, uint16_t default_value = 0) { return get_number(key, default_value); }
+    uint32_t getUInt(const char* key, uint32_t default_value = 0) { return get_number(key, default_value); }
+    int32_t getInt(const char* key, int32_t default_value = 0) { return get_number(key, default_value); }
+    int64_t getLong64(const char* key, int64_t default_value = 0) { return get_number(key, default_value); }
+    bool getBool(const char* key, bool default_value = false) { return get_number(key, (int64_t)default_value) != 0; }
+    String getString(const char* key, const String default_value = String());
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buffer, size_t max_len);
+
+  private:
+    bool put(const char* key, const std::string& value);
+    bool get(const char* key, std::string& value);
+    int64_t get_number(const char* key, int64_t default_value) {
+      std::string value;
+      return get(key, value) ? strtoll(value.c_str(), NULL, 10) : default_value;
+    }
+
+    std::string name_;
+    bool read_only_ = true;
+    bool started_ = false;
+};
+
+#endif
@@ -0,0 +1,79 @@
+// host stand-in for the buffering streams from bblanchon/StreamUtils
+
+#ifndef NATIVE_STREAMUTILS_H
+#define NATIVE_STREAMUTILS_H
+
+#include <Arduino.h>
+#include <algorithm>
+#include <vector>
+
+class ReadBufferingStream : public Stream {
+  public:
+    ReadBufferingStream(Stream& upstream, size_t capacity) : upstream_(upstream), buffer_(capacity) {}
+
+    int available() override { return (end_ - begin_) + upstream_.available(); }
+    int read() override {
+      if (!fill()) return -1;
+      return (uint8_t)buffer_[begin_++];
+    }
+    int peek() override {
+      if (!fill()) return -1;
+      return (uint8_t)buffer_[begin_];
+    }
+    size_t readBytes(char* buffer, size_t length) override {
+      size_t count = 0;
+      while (count < length && fill()) {
+        size_t n = std::min(length - count, end_ - begin_);
+        memcpy(buffer + count, &buffer_[begin_], n);
+        begin_ += n;
+        count += n;
+      }
+      return count;
+    }
+    size_t write(uint8_t c) override { return upstream_.write(c); }
+    using Print::write;
+
+  private:
+    bool fill(void) {
+      if (begin_ < end_) {
+        return true;
+      }
+      begin_ = 0;
+      end_ = upstream_.readBytes(buffer_.data(), buffer_.size());
+      return end_ > 0;
+    }
+
+    Stream& upstream_;
+    std::vector<char> buffer_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+};
+
+
+class WriteBufferingStream : public Print {
+  public:
+    WriteBufferingStream(Print& upstream, size_t capacity) : upstream_(upstream), capacity_(capacity) { buffer_.reserve(capacity); }
+    ~WriteBufferingStream() { flush(); }
+
+    size_t write(uint8_t c) override {
+      buffer_.push_back((char)c);
+      if (buffer_.size() >= capacity_) {
+        flush();
+      }
+      return 1;
+    }
+    using Print::write;
+    void flush() override {
+      if (!buffer_.empty()) {
+        upstream_.write((const uint8_t*)buffer_.data(), buffer_.size());
+        buffer_.clear();
+      }
+    }
+
+  private:
+    Print& upstream_;
+    size_t capacity_;
+    std::vector<char> buffer_;
+};
+
+#endif
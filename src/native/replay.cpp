@@ -0,0 +1,224 @@
+// [env:native] replays the events file on a simulated clock.
+//
+// usage: program replay [--start YYYY-MM-DD] [--days N] [--step SECONDS] [--tz POSIX_TZ]... [--quiet]
+//
+// for each timezone the events file is loaded at local midnight of the start date and the simulated clock is advanced
+// by step seconds at a time, calling check_for_recent_events() after every step the same way loop() does.
+// step defaults to EVENT_CHECK_INTERVAL, the backstop check in loop(). a step of 0 jumps straight to the next scheduled event instead,
+// the way main.cpp's event timer wakes loop().
+// every notice the scheduler queues is reported with its scheduled time and how late it fired (latency),
+// followed by a summary with the CPU time spent loading the events and checking the schedule.
+//
+// a fire whose local time of day differs from the event's start time is an error unless the UTC offset changed that day,
+// i.e. the start time fell into the hour skipped when DST begins. errors make the program exit with 1 so it can
+// be used to check changes to the scheduler.
+
+#include "replay.h"
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "config.h"
+#include "scheduler.h"
+#include "audio_queue.h"
+#include "storage.h"
+
+static time_t sim_now = 0;
+
+static const char* default_tzs[] = {
+  "UTC0",
+  "EST5EDT,M3.2.0,M11.1.0", // America/New_York
+  "CET-1CEST,M3.5.0,M10.5.0/3", // Europe/Berlin
+  "AEST-10AEDT,M10.1.0,M4.1.0/3", // Australia/Sydney, DST over the new year
+  "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0", // Australia/Lord_Howe, 30 minute DST
+};
+
+struct ReplayTotals {
+  uint32_t fires = 0;
+  uint32_t errors = 0;
+  double load_cpu_ms = 0;
+  double loop_cpu_ms = 0;
+  double reschedule_cpu_ms = 0;
+};
+
+
+static time_t sim_clock(time_t* t) {
+  if (t) {
+    *t = sim_now;
+  }
+  return sim_now;
+}
+
+
+static double cpu_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec*1000.0 + ts.tv_nsec/1000000.0;
+}
+
+
+static long utc_offset(time_t t) {
+  struct tm local = {0};
+  localtime_r(&t, &local);
+  return local.tm_gmtoff;
+}
+
+
+static const Event* find_event(uint32_t id) {
+  for (const Event& event : events) {
+    if (event.id == id) {
+      return &event;
+    }
+  }
+  return nullptr;
+}
+
+
+static void replay_tz(const char* tz, int32_t start_day, int32_t days, uint32_t step, bool quiet, ReplayTotals& totals) {
+  setenv("TZ", tz, 1);
+  tzset();
+  tz_table_rebuild((time_t)start_day*86400);
+
+  const time_t start = local_to_epoch(start_day, 0);
+  const time_t end = local_to_epoch(start_day + days, 0);
+
+  uint16_t dst_transitions = 0;
+  for (time_t t = start + 3600; t < end; t += 3600) {
+    if (utc_offset(t) != utc_offset(t - 3600)) {
+      dst_transitions++;
+    }
+  }
+
+  struct AudioMessage am;
+  while (xQueueReceive(qaudio_messages, &am, 0) == pdTRUE); // left over from the last timezone
+
+  sim_now = start;
+  scheduler_watermark = 0; // nothing has been missed before the replay starts
+  double wall_start = millis();
+  double cpu_start = cpu_ms();
+  load_events_file();
+  double load_cpu = cpu_ms() - cpu_start;
+
+  uint32_t fires = 0;
+  uint32_t errors = 0;
+  uint32_t rescheduling_checks = 0;
+  double latency_sum = 0;
+  time_t latency_max = 0;
+  double reschedule_cpu = 0;
+  // reading the CPU clock is a system call, so the whole loop is timed once and only the checks that reschedule are timed separately
+  double loop_start = cpu_ms();
+  while (sim_now < end) {
+    if (step > 0) {
+      sim_now += step;
+    }
+    else if (next_scheduled_fire() != 0 && next_scheduled_fire() < end) {
+      sim_now = std::max(sim_now, next_scheduled_fire());
+    }
+    else {
+      break;
+    }
+
+    // only checks that find something due call reschedule(), the rest just look at the top of the heap
+    bool due = !schedule.empty() && events[schedule.front()].next_fire <= sim_now;
+    if (due) {
+      cpu_start = cpu_ms();
+      check_for_recent_events(0);
+      reschedule_cpu += cpu_ms() - cpu_start;
+      rescheduling_checks++;
+    }
+    else {
+      check_for_recent_events(0);
+    }
+
+    while (xQueueReceive(qaudio_messages, &am, 0) == pdTRUE) {
+      fires++;
+      time_t latency = sim_now - am.timestamp;
+      latency_sum += latency;
+      latency_max = std::max(latency_max, latency);
+
+      struct tm local = {0};
+      localtime_r(&am.timestamp, &local);
+      const Event* event = find_event(am.id);
+      int32_t time_of_day = local.tm_hour*3600 + local.tm_min*60 + local.tm_sec;
+      const char* note = "";
+      bool error = false;
+      if (event && time_of_day != event->rule.time_of_day) {
+        if (utc_offset(am.timestamp) != utc_offset(am.timestamp - 86400)) {
+          note = "  (start time skipped by DST change)";
+        }
+        else {
+          note = "  ERROR: not at the start time";
+          error = true;
+          errors++;
+        }
+      }
+      if (!quiet || error) {
+        char buffer[40];
+        strftime(buffer, sizeof(buffer), "%a %Y-%m-%d %H:%M:%S %Z", &local);
+        printf("%s  id %3u  %s  latency %2lds%s\n", tz, (unsigned)am.id, buffer, (long)latency, note);
+      }
+    }
+  }
+  double loop_cpu = cpu_ms() - loop_start;
+
+  printf("%s: %u fires, latency mean %.2fs max %lds, %u errors, %u DST transitions\n", tz, fires, fires ? latency_sum/fires : 0.0, (long)latency_max, errors, dst_transitions);
+  printf("%s: cpu load_events_file() %.3f ms, replay loop %.3f ms, %.3f ms of that in %u checks that rescheduled events, replayed in %.0f ms\n\n",
+         tz, load_cpu, loop_cpu, reschedule_cpu, rescheduling_checks, millis() - wall_start);
+
+  totals.fires += fires;
+  totals.errors += errors;
+  totals.load_cpu_ms += load_cpu;
+  totals.loop_cpu_ms += loop_cpu;
+  totals.reschedule_cpu_ms += reschedule_cpu;
+}
+
+
+int replay_main(int argc, char* argv[]) {
+  int32_t start_day = days_from_civil(2025, 1, 1);
+  int32_t days = 365;
+  uint32_t step = EVENT_CHECK_INTERVAL/1000;
+  bool quiet = false;
+  std::vector<const char*> tzs;
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "--start") == 0 && i+1 < argc) {
+      int y, m, d;
+      if (sscanf(argv[++i], "%d-%d-%d", &y, &m, &d) != 3) {
+        fprintf(stderr, "--start must be YYYY-MM-DD\n");
+        return 1;
+      }
+      start_day = days_from_civil(y, m, d);
+    }
+    else if (strcmp(argv[i], "--days") == 0 && i+1 < argc) {
+      days = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--step") == 0 && i+1 < argc) {
+      step = strtoul(argv[++i], NULL, 10);
+    }
+    else if (strcmp(argv[i], "--tz") == 0 && i+1 < argc) {
+      tzs.push_back(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--quiet") == 0) {
+      quiet = true;
+    }
+    else {
+      fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (tzs.empty()) {
+    tzs.assign(std::begin(default_tzs), std::end(default_tzs));
+  }
+
+  scheduler_clock = sim_clock;
+  ReplayTotals totals;
+  for (const char* tz : tzs) {
+    replay_tz(tz, start_day, days, step, quiet, totals);
+  }
+  scheduler_clock = time;
+
+  printf("total: %u fires, %u errors, cpu load_events_file() %.3f ms, replay loop %.3f ms (%.3f ms rescheduling)\n",
+         totals.fires, totals.errors, totals.load_cpu_ms, totals.loop_cpu_ms, totals.reschedule_cpu_ms);
+  return totals.errors ? 1 : 0;
+}
@@ -0,0 +1,8 @@
+// [env:native] replays the events file on a simulated clock. see replay.cpp
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+int replay_main(int argc, char* argv[]);
+
+#endif
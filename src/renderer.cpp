@@ -0,0 +1,893 @@
+#include "renderer.h"
+
+#include <Preferences.h>
+
+#include <atomic>
+
+#include "scheduler.h"
+
+// any changes to LEDS_ORIGIN_OFFSET here will be overwritten.
+// LEDS_ORIGIN_OFFSET is set in the frontend.
+// and DEFAULT_LEDS_ORIGIN_OFFSET is set in platformio.ini.
+// since you may be physically limited where you place the first LED when assembling the button
+// LEDS_ORIGIN_OFFSET lets you adjust where the apparent origin is. for example, if the first
+// LED is physically wired at 1 o'clock you change LEDS_ORIGIN_OFFSET to a value different from
+// 0 such that origin *appears* as if it is at 6 o'clock.
+uint16_t LEDS_ORIGIN_OFFSET = 0;
+// any changes to NUM_LEDS here will be overwritten.
+// NUM_LEDS is set in the frontend.
+// and DEFAULT_NUM_LEDS is set in platformio.ini.
+uint16_t NUM_LEDS = 0;
+CRGB* leds; // the frame FastLED sends. frames are composited into back_leds and the two are swapped when one is handed to led_output().
+static CRGB* back_leds;
+uint8_t homogenized_brightness = 255;
+
+
+struct RenderStats render_stats = {0};
+struct AnimationClock animation_clock = {0};
+// everything from here to the mailbox is only used by visual_notifier()'s task
+static bool frame_dirty = false; // something was composited or the brightness changed since the last frame was sent
+static uint32_t frame_dirty_ms = 0; // millis() when frame_dirty was set
+static uint32_t frame_due_ms = 0; // millis() when show() may send the next frame
+static uint32_t last_frame_ms = 0;
+static uint8_t frame_brightness = 255;
+// calculate_unscaled_power_mW() of back_leds. it only changes when pixels are written, not when the brightness changes or a single notice spins.
+static uint32_t frame_power_mW = 0;
+static bool frame_power_valid = false;
+
+// the first frame of a notice as drawn by fill(). notices waiting their turn get a new layer every time they come round and twinkle
+// refills ten times a second, so the frame is copied back into the layer instead of being drawn again. NUM_LEDS and LEDS_ORIGIN_OFFSET
+// only change with a restart, so the color passed to fill() is all that identifies a frame.
+struct CompiledFrame {
+  uint32_t color;
+  uint32_t power_mW; // calculate_unscaled_power_mW() of pixels, so max_brightness_for_power() does not sum them again either
+  uint32_t last_used;
+  CRGB* pixels;
+};
+static struct CompiledFrame compiled_frames[COMPILED_FRAMES_MAX];
+static uint8_t num_compiled_frames = 0;
+static uint32_t compiled_frames_used = 0;
+
+static struct NoticeLayer layers[NOTICE_LAYERS_MAX]; // every one up to max_layers owns a pixels buffer, even when not showing a notice
+static uint8_t max_layers = 0; // set by renderer_setup() before either task starts, so loop() reads it too
+static uint8_t num_layers = 0; // layers showing a notice
+static bool layout_changed = false; // the notices shown changed, so every segment is composited again
+
+// a notice as loop() posts it. the pattern and color are already resolved, the render task never looks at events.
+struct ShownNotice {
+  uint16_t id;
+  const struct PatternDescriptor* pattern;
+  uint32_t color;
+};
+
+struct NoticeSet {
+  uint8_t count;
+  struct ShownNotice notices[NOTICE_LAYERS_MAX];
+};
+
+// the mailbox is a triple buffer. loop() fills notice_sets[posting_set] and exchanges it for the set in notice_mailbox,
+// the render task exchanges its reading_set for that one when NOTICES_POSTED is set. neither ever waits for the other and
+// the render task always gets the latest set, a set it never picked up is simply written over.
+#define NOTICES_POSTED 0x80
+static struct NoticeSet notice_sets[3];
+static std::atomic<uint8_t> notice_mailbox(2);
+static uint8_t posting_set = 0; // loop() only
+static uint8_t reading_set = 1; // render task only
+
+// wakes visual_notifier() when notices are posted or led_output() is done with a frame
+static QueueHandle_t qrender_wakes = xQueueCreate(1, sizeof(uint8_t));
+struct OutputFrame {
+  CRGB* pixels;
+  uint8_t brightness;
+};
+static QueueHandle_t qoutput_frames = xQueueCreate(1, sizeof(struct OutputFrame));
+static std::atomic<bool> is_output_running(false); // show() sends frames itself until led_output() is running
+static std::atomic<bool> is_output_busy(false);
+
+// the notices loop() shows. active_notices is rebuilt from events only when notices_version changes,
+// so a pass of loop() does not look at every event.
+static std::vector<uint16_t> active_notices; // indices into events of the events with a notice
+static uint32_t active_notices_version = 0;
+static bool is_active_notices_built = false;
+static uint16_t first_shown = 0; // index into active_notices of the first notice posted while the notices take turns
+static uint32_t turn_due_ms = 0;
+
+
+void renderer_setup(void) {
+  Preferences preferences;
+  preferences.begin("config", true);
+  NUM_LEDS = preferences.getUChar("num_leds", DEFAULT_NUM_LEDS);
+  LEDS_ORIGIN_OFFSET = preferences.getUChar("origin_offset", DEFAULT_LEDS_ORIGIN_OFFSET);
+  preferences.end();
+
+  leds = (CRGB*)malloc(NUM_LEDS*sizeof(CRGB));
+  back_leds = (CRGB*)malloc(NUM_LEDS*sizeof(CRGB));
+  fill_solid(back_leds, NUM_LEDS, CRGB::Black);
+  max_layers = NUM_LEDS/NOTICE_SEGMENT_MIN_LEDS;
+  if (max_layers < 1) {
+    max_layers = 1;
+  }
+  else if (max_layers > NOTICE_LAYERS_MAX) {
+    max_layers = NOTICE_LAYERS_MAX;
+  }
+  for (uint8_t k = 0; k < max_layers; k++) {
+    layers[k].pixels = (CRGB*)malloc(NUM_LEDS*sizeof(CRGB));
+    if (layers[k].pixels == nullptr) {
+      DEBUG_PRINTLN("renderer_setup(): Out of memory, fewer notices will be shown at once.");
+      max_layers = k;
+      break;
+    }
+  }
+  // FastLED.setMaxPowerInVoltsAndMilliamps() is not used. its limiter sums every pixel again on every FastLED.show(),
+  // composite() limits the frame's brightness with max_brightness_for_power() instead, which only sums them after they change.
+  FastLED.setCorrection(TypicalSMD5050);
+  FastLED.addLeds<WS2812B, DATA_PIN, COLOR_ORDER>(leds, NUM_LEDS);
+
+  FastLED.clear();
+  FastLED.show(); // clear the matrix on startup
+
+  homogenize_brightness();
+  FastLED.setBrightness(homogenized_brightness);
+  frame_brightness = homogenized_brightness;
+}
+
+
+// the timer comes due as soon as it is started, so it starts one interval after the first timer_ticks() instead
+void timer_reset(struct AnimationTimer& timer) {
+  timer.is_running = false;
+}
+
+
+// the number of times the timer came due since the last call, usually 0 or 1. more than 1 means loop() was busy
+// and the caller should step its animation that many times. interval is given on every call so a pattern can change it.
+uint16_t timer_ticks(struct AnimationTimer& timer, uint16_t interval) {
+  if (interval == 0) {
+    interval = 1;
+  }
+  const uint32_t now = animation_clock.now;
+  uint16_t ticks = 0;
+  if (!timer.is_running) {
+    timer.due_ms = now + interval;
+    timer.is_running = true;
+  }
+  else if ((int32_t)(now - timer.due_ms) >= 0) {
+    uint32_t due = (now - timer.due_ms)/interval + 1;
+    if (due > ANIMATION_CATCH_UP_MAX) {
+      render_stats.ticks_lost += due - ANIMATION_CATCH_UP_MAX;
+      ticks = ANIMATION_CATCH_UP_MAX;
+      timer.due_ms = now + interval;
+    }
+    else {
+      ticks = due;
+      timer.due_ms += due*interval;
+    }
+    render_stats.ticks_caught_up += ticks - 1;
+  }
+  if (!animation_clock.is_due_set || (int32_t)(timer.due_ms - animation_clock.next_due_ms) < 0) {
+    animation_clock.next_due_ms = timer.due_ms;
+    animation_clock.is_due_set = true;
+  }
+  return ticks;
+}
+
+
+// the same result as calculate_max_brightness_for_power_vmA(back_leds, NUM_LEDS, target_brightness, LED_STRIP_VOLTAGE, LED_STRIP_MILLIAMPS)
+// for the frame being composited, but the pixels are only summed again after they change, not every time the brightness does.
+uint8_t max_brightness_for_power(uint8_t target_brightness) {
+  if (!frame_power_valid) {
+    frame_power_mW = calculate_unscaled_power_mW(back_leds, NUM_LEDS);
+    frame_power_valid = true;
+  }
+  const uint32_t max_power_mW = (uint32_t)LED_STRIP_VOLTAGE*LED_STRIP_MILLIAMPS;
+  uint32_t requested_power_mW = (frame_power_mW*target_brightness)/256;
+  if (requested_power_mW <= max_power_mW) {
+    return target_brightness;
+  }
+  return ((uint32_t)target_brightness*max_power_mW)/requested_power_mW;
+}
+
+
+// When FastLED's power management functions are used FastLED dynamically adjusts the brightness level to be as high as possible while
+// keeping the power draw near the specified level. This can lead to the brightness level of an animation noticeably increasing when
+// fewer LEDs are lit and the brightness noticeably dipping when more LEDs are lit or their colors change.
+// homogenize_brightness() learns the lowest brightness level of all the animations and uses it across every animation to keep a consistent
+// brightness level. This will lead to dimmer animations and power usage almost always a good bit lower than what the FastLED power
+// management function was set to aim for. Set the #define for HOMOGENIZE_BRIGHTNESS to false to disable this feature.
+void homogenize_brightness(void) {
+    uint8_t max_brightness = max_brightness_for_power(homogenized_brightness);
+    if (max_brightness < homogenized_brightness) {
+        homogenized_brightness = max_brightness;
+    }
+}
+
+
+// writes a frame to the strip. led_output() calls this, or show() before led_output() is running.
+static void send_frame(const struct OutputFrame& frame) {
+  uint32_t start = micros();
+  FastLED[0].setLeds(frame.pixels, NUM_LEDS);
+  FastLED.setBrightness(frame.brightness);
+  FastLED.show();
+  render_stats.show_us = micros() - start;
+  if (render_stats.show_us > render_stats.show_us_max) {
+    render_stats.show_us_max = render_stats.show_us;
+  }
+}
+
+
+// the frame was changed by composite() or set_brightness()
+static void mark_frame_dirty(void) {
+  if (!frame_dirty) {
+    frame_dirty = true;
+    frame_dirty_ms = millis();
+  }
+}
+
+
+// the brightness the frame is sent with. only marks the frame dirty if the brightness actually changed.
+void set_brightness(uint8_t brightness) {
+  if (brightness != frame_brightness) {
+    frame_brightness = brightness;
+    mark_frame_dirty();
+  }
+}
+
+
+// how long until show() has another frame slot
+uint32_t ms_until_next_frame(void) {
+  int32_t wait = (int32_t)(frame_due_ms - millis());
+  return (wait > 0) ? wait : 0;
+}
+
+
+// called on every pass of visual_notifier(). hands a frame to led_output() at most every RENDER_FRAME_INTERVAL milliseconds
+// and only if it differs from the last one, e.g. a SOLID notice is sent once. back_leds becomes leds, the buffer FastLED sends,
+// and the old leds becomes the back buffer, so the next frame is composited while this one is written to the strip.
+// a WS2812B takes about 30 us per LED to write, led_output() does that without holding up the render task.
+void show(void) {
+  uint32_t now = millis();
+  if ((int32_t)(now - frame_due_ms) < 0) {
+    return;
+  }
+  if (!frame_dirty) {
+    render_stats.skipped++;
+    frame_due_ms = now + RENDER_FRAME_INTERVAL;
+    return;
+  }
+  if (is_output_busy) {
+    // led_output() wakes the task when it is done
+    render_stats.output_busy++;
+    return;
+  }
+  // how late the frame is, counted from when it changed since the task sleeps through frame slots with nothing to send
+  uint32_t due = ((int32_t)(frame_dirty_ms - frame_due_ms) > 0) ? frame_dirty_ms : frame_due_ms;
+  uint32_t late = now - due;
+  render_stats.dropped += late/RENDER_FRAME_INTERVAL;
+  if (late > render_stats.late_ms_max) {
+    render_stats.late_ms_max = late;
+  }
+  frame_due_ms = now + RENDER_FRAME_INTERVAL;
+  frame_dirty = false;
+
+  homogenize_brightness();
+  struct OutputFrame frame = {back_leds, frame_brightness};
+  back_leds = leds;
+  leds = frame.pixels;
+  render_stats.frame_ms = now - last_frame_ms;
+  last_frame_ms = now;
+  render_stats.frames++;
+  if (is_output_running) {
+    is_output_busy = true;
+    xQueueSend(qoutput_frames, &frame, 0);
+  }
+  else {
+    send_frame(frame);
+  }
+}
+
+
+uint16_t idx(uint16_t index_in) {
+  return (LEDS_ORIGIN_OFFSET + index_in) % NUM_LEDS;
+}
+
+
+static void set_layer_brightness(struct NoticeLayer& layer, uint8_t brightness) {
+  if (brightness != layer.brightness) {
+    layer.brightness = brightness;
+    layer.changed = true;
+  }
+}
+
+
+// fill_compiled() into the layer's pixels
+static void fill_layer(struct NoticeLayer& layer, uint32_t color) {
+  layer.power_mW = fill_compiled(layer.pixels, color);
+  layer.is_power_known = true;
+  layer.changed = true;
+  layer.repainted = true;
+}
+
+
+void breathing(struct NoticeLayer& layer, uint16_t draw_interval) {
+  const uint8_t min_brightness = 2;
+  uint16_t ticks = timer_ticks(layer.timer, draw_interval);
+  if (ticks > 0) {
+    // composite() limits the frame to the maximum power delivered, so use the following function to find the _actual_ maximum brightness allowed for
+    // these power consumption settings. setting brightness to a value higher that max_brightness will not actually increase the brightness.
+    uint8_t max_brightness = max_brightness_for_power(homogenized_brightness);
+    uint8_t b = scale8(triwave8(layer.step), max_brightness-min_brightness)+min_brightness;
+
+    set_layer_brightness(layer, b);
+
+    layer.step += ticks; // a step for every tick, so the breath keeps its pace when loop() was busy
+  }
+}
+
+
+void blink(struct NoticeLayer& layer, uint16_t draw_interval, uint8_t num_blinks, uint8_t num_intervals_off) {
+  for (uint16_t ticks = timer_ticks(layer.timer, draw_interval); ticks > 0; ticks--) {
+    if (layer.step < (2*num_blinks)) {
+      uint8_t b = (layer.step % 2 == 0) ? homogenized_brightness : 0;
+      set_layer_brightness(layer, b);
+    }
+    layer.step++;
+    if (layer.step >= 2*num_blinks + num_intervals_off-1) {
+      layer.step = 0;
+    }
+  }
+}
+ 
+
+//uint16_t forwards(uint16_t index_in) {
+//  return index_in;
+//}
+
+
+uint16_t backwards(uint16_t index_in) {
+  return idx((NUM_LEDS-1)-index_in);
+}
+
+
+// moves the pixels one place along the order dfp(idx(i)) every draw_interval milliseconds. no pixels are moved, only layer.phase
+// changes and the compositor reads the pixels rotated by it, so a step costs the same for any number of LEDs.
+// every tick of the timer is a step, so a ring with more LEDs than frames per rotation skips steps instead of slowing down.
+void spin(struct NoticeLayer& layer, uint16_t draw_interval, uint16_t(*dfp)(uint16_t)) {
+  // idx() and backwards() only shift and mirror the ring, so dfp(idx(i)) steps by the same +1 or -1 for every i
+  // and a step of the spin is a rotation of the whole layer one way or the other.
+  bool reversed = ((*dfp)(idx(1 % NUM_LEDS)) == ((*dfp)(idx(0)) + 1) % NUM_LEDS);
+  uint16_t steps = timer_ticks(layer.timer, draw_interval) % NUM_LEDS;
+  if (steps > 0) {
+    layer.phase = (reversed ? layer.phase + NUM_LEDS - steps : layer.phase + steps) % NUM_LEDS;
+    layer.changed = true;
+  }
+}
+
+
+void twinkle(CRGB* pixels) {
+  for(uint16_t i = 0; i < NUM_LEDS; i++) {
+    if (random8() < 16) {
+      // no real reason to use idx() since these are random indices
+      pixels[i] = CRGB::White - pixels[i];
+    }
+  }
+}
+
+
+void fill_gradient_RGB_circular(CRGB* leds, CRGB start_color, CRGB end_color) {
+  CRGBPalette16 palette;
+  for (uint8_t i = 0; i < 16; i++) {
+      float ratio = i / 15.0;
+      palette[i] = blend(start_color, end_color, ratio*255);
+  }
+  for (uint16_t i = 0; i < NUM_LEDS; i++) {
+    leds[idx(i)] = ColorFromPalette(palette, (i*255)/NUM_LEDS);
+  }
+}
+
+
+// built from SPECIAL_COLOR_LIST when compiling, the same as pattern_registry and patterns_json
+#define SPECIAL_COLOR_DESCRIPTOR(name, value, label, first, second) {value, label, first, second},
+constexpr struct SpecialColorDescriptor special_color_registry[] = {
+  SPECIAL_COLOR_LIST(SPECIAL_COLOR_DESCRIPTOR)
+};
+constexpr uint8_t num_special_colors = sizeof(special_color_registry)/sizeof(special_color_registry[0]);
+
+#define SPECIAL_COLOR_JSON(name, value, label, first, second) "{\"n\":\"" label "\",\"v\":\"" #value "\"},"
+const char special_colors_json[] PROGMEM = "{\"special_colors\":[" SPECIAL_COLOR_LIST(SPECIAL_COLOR_JSON) "{\"n\":\"?????\",\"v\":\"0xFFFFFFFF\"}]}";
+
+
+const struct SpecialColorDescriptor* find_special_color(uint32_t value) {
+  for (uint8_t i = 0; i < num_special_colors; i++) {
+    if (special_color_registry[i].value == value) {
+      return &special_color_registry[i];
+    }
+  }
+  return nullptr;
+}
+
+
+// fills pixels[idx(from)] to pixels[idx(to-1)]. idx() only shifts the ring, so that is at most two runs of the array.
+void fill_ring(CRGB* pixels, uint16_t from, uint16_t to, const CRGB& color) {
+  if (from >= to) {
+    return;
+  }
+  uint16_t start = idx(from);
+  uint16_t length = to - from;
+  uint16_t run = (length < NUM_LEDS - start) ? length : NUM_LEDS - start;
+  fill_solid(pixels + start, run, color);
+  fill_solid(pixels, length - run, color);
+}
+
+
+void fill(CRGB* pixels, uint32_t color) {
+  // regular RGB color only uses 24 bits but if color is stored in 32 bits
+  // we can utilize the unused upper bits to indicate a color is special
+  // colors less than or equal to 0x00FFFFFF are normal RGB colors
+  uint8_t color_flag = (color >> 24);
+  if (color_flag == 0x00) {
+    fill_solid(pixels, NUM_LEDS, color);
+  }
+  else if (color_flag == 0x01) {
+    // 0x01------ flag indicates special colors
+    if (static_cast<SpecialColor>(color) == RAINBOW) {
+      // cannot manipulate the LED indices with idx() for fill_rainbow_circular, but can change the hue at pixels[0] which
+      // accomplishes the same goal of changing the apparent origin of the LEDs
+      const uint16_t hueChange = 65535 / (uint16_t) NUM_LEDS;  // hue change for each LED, * 256 for precision (256 * 256 - 1)
+      uint16_t initialhue = (uint8_t)((LEDS_ORIGIN_OFFSET*hueChange) >> 8);  // assign new hue with precise offset (as 8-bit)
+      fill_rainbow_circular(pixels, NUM_LEDS, initialhue);
+    }
+    else {
+      //fill_gradient_RGB() shows colors more distinctly than fill_gradient()
+      //half and half looks better than a gradient since the button cover already diffuses the color
+      const struct SpecialColorDescriptor* special = find_special_color(color);
+      // black and pink is used to indicate something went wrong during testing
+      fill_ring(pixels, 0, NUM_LEDS/2, special ? special->first_half : (uint32_t)CRGB::Black);
+      fill_ring(pixels, NUM_LEDS/2, NUM_LEDS, special ? special->second_half : (uint32_t)CRGB::Pink);
+    }
+  }
+  else if (color_flag == 0x02) {
+    // 0x02------ flag indicates to fade color across gradient fill
+    color = color & 0x00FFFFFF;
+    CRGB color_dim = color;
+    color_dim.nscale8(20); // lower numbers are closer to black
+    fill_gradient_RGB_circular(pixels, color, color_dim);
+  }
+  else {
+    // black and pink is used to indicate something went wrong during testing
+    fill_gradient_RGB_circular(pixels, CRGB::Black, CRGB::Pink);
+  }
+}
+
+
+// the same as fill(pixels, color) but the pixels are copied from compiled_frames when the color was drawn before.
+// the least recently used frame is replaced when there are more than COMPILED_FRAMES_MAX colors.
+// returns calculate_unscaled_power_mW() of the pixels, kept with the frame so it is not summed again either.
+uint32_t fill_compiled(CRGB* pixels, uint32_t color) {
+  compiled_frames_used++;
+  struct CompiledFrame* frame = nullptr;
+  for (uint8_t i = 0; i < num_compiled_frames; i++) {
+    if (compiled_frames[i].color == color) {
+      frame = &compiled_frames[i];
+      memcpy(pixels, frame->pixels, NUM_LEDS*sizeof(CRGB));
+      frame->last_used = compiled_frames_used;
+      return frame->power_mW;
+    }
+    if (frame == nullptr || compiled_frames[i].last_used < frame->last_used) {
+      frame = &compiled_frames[i];
+    }
+  }
+
+  fill(pixels, color);
+  if (num_compiled_frames < COMPILED_FRAMES_MAX) {
+    CRGB* frame_pixels = (CRGB*)malloc(NUM_LEDS*sizeof(CRGB));
+    if (frame_pixels == nullptr) {
+      // fill() already drew it, it just is not kept
+      return calculate_unscaled_power_mW(pixels, NUM_LEDS);
+    }
+    frame = &compiled_frames[num_compiled_frames++];
+    frame->pixels = frame_pixels;
+  }
+  frame->color = color;
+  memcpy(frame->pixels, pixels, NUM_LEDS*sizeof(CRGB));
+  frame->power_mW = calculate_unscaled_power_mW(pixels, NUM_LEDS);
+  frame->last_used = compiled_frames_used;
+  return frame->power_mW;
+}
+
+
+void draw_solid(struct NoticeLayer& layer) {
+  set_layer_brightness(layer, homogenized_brightness);
+  if (layer.refill) {
+    fill_layer(layer, layer.color);
+  }
+}
+
+
+void draw_breathe(struct NoticeLayer& layer) {
+  if (layer.refill) {
+    fill_layer(layer, layer.color);
+  }
+  breathing(layer, 10);
+}
+
+
+void draw_blink(struct NoticeLayer& layer) {
+  if (layer.refill) {
+    fill_layer(layer, layer.color);
+  }
+  blink(layer, 200, 3, 10);
+}
+
+
+void draw_spin(struct NoticeLayer& layer) {
+  set_layer_brightness(layer, homogenized_brightness);
+  if (layer.refill) {
+    uint32_t color = layer.color;
+    if (color <= 0x00FFFFFF) {
+      // 0x02------ flag indicates to fade color across gradient fill
+      // the change in brightness across the fill makes it possible to see the spinning motion
+      color += (0x02 << 24);
+    }
+    fill_layer(layer, color);
+  }
+  // complete rotation about every 2 seconds independent of the number of LEDs
+  spin(layer, 2000/NUM_LEDS, &backwards);
+}
+
+
+void draw_twinkle(struct NoticeLayer& layer) {
+  set_layer_brightness(layer, homogenized_brightness);
+  // twinkles missed while loop() was busy are not made up, they would only be drawn over each other
+  if (timer_ticks(layer.timer, 100) > 0 || layer.refill) {
+    // twinkles should only show momentarily
+    // by refilling every time the twinkles from the previous draw disappear
+    fill_layer(layer, layer.color);
+    twinkle(layer.pixels);
+    layer.is_power_known = false;
+  }
+}
+
+
+// both are built from PATTERN_LIST when compiling, so there is nothing to do at boot and the JSON is served straight from flash.
+#define PATTERN_DESCRIPTOR(name, value, label, draw) {value, label, draw},
+constexpr struct PatternDescriptor pattern_registry[] = {
+  PATTERN_LIST(PATTERN_DESCRIPTOR)
+};
+constexpr uint8_t num_patterns = sizeof(pattern_registry)/sizeof(pattern_registry[0]);
+
+// every entry ends in a comma, so the random pattern the frontend also offers goes last
+#define PATTERN_JSON(name, value, label, draw) "{\"n\":\"" label "\",\"v\":\"" #value "\"},"
+const char patterns_json[] PROGMEM = "{\"patterns\":[" PATTERN_LIST(PATTERN_JSON) "{\"n\":\"?????\",\"v\":255}]}";
+
+
+const struct PatternDescriptor* find_pattern(uint8_t value) {
+  for (uint8_t i = 0; i < num_patterns; i++) {
+    if (pattern_registry[i].value == value) {
+      return &pattern_registry[i];
+    }
+  }
+  return nullptr;
+}
+
+
+// the pattern and color an event's notice is shown with. random ones are picked from the timestamp,
+// so a notice looks the same every time it comes round.
+static void resolve_notice(const struct Event& event, const struct PatternDescriptor** pattern, uint32_t* color) {
+  // NOTE:
+  // a design decision was made that the color used by a pattern will not evolve over time.
+  // shifting colors are visually appealing, but they are counter productive to serving as a visual indicator
+  // for example: one event is blinking blue, and another event is blinking with a shifting color
+  //              the shifting color will eventually show blue, so you would have two separate events showing
+  //              the same visual indicator.
+  uint8_t randomness = (uint8_t)event.timestamp;
+  *pattern = find_pattern(event.pattern);
+  if (event.pattern == RANDOM_PATTERN) {
+    *pattern = &pattern_registry[randomness % num_patterns];
+  }
+  *color = event.color;
+  if (*color == 0xFFFFFFFF) {
+    // 0xFFFFFFFF indicates a random color should be used
+    bool do_basic = randomness % 3;
+
+    if (do_basic) {
+      *color = (uint32_t)(CRGB)CHSV((randomness % 255), 255, 255);
+      *color &= 0x00FFFFFF; // make sure the upper bits are zero to indicate a basic color
+    }
+    else {
+      // do special color
+      *color = special_color_registry[randomness % num_special_colors].value;
+    }
+  }
+}
+
+
+static void start_layer(struct NoticeLayer& layer) {
+  fill_solid(layer.pixels, NUM_LEDS, CRGB::Black); // in case there is no pattern to draw it
+  layer.power_mW = 0;
+  layer.is_power_known = true;
+  layer.brightness = homogenized_brightness;
+  layer.phase = 0;
+  layer.step = 0;
+  timer_reset(layer.timer);
+  layer.refill = true;
+  layer.changed = true;
+  layer.repainted = true;
+}
+
+
+// takes the latest set loop() posted, or returns nullptr if nothing was posted since the last time
+static const struct NoticeSet* take_notices(void) {
+  if ((notice_mailbox.load() & NOTICES_POSTED) == 0) {
+    return nullptr;
+  }
+  reading_set = notice_mailbox.exchange(reading_set) & ~NOTICES_POSTED;
+  return &notice_sets[reading_set];
+}
+
+
+// puts the notices posted into layers. a notice that was already shown with the same pattern and color keeps its layer,
+// so its animation carries on instead of starting over whenever another notice comes or goes.
+static void assign_layers(const struct NoticeSet& set) {
+  uint8_t n = (set.count < max_layers) ? set.count : max_layers;
+
+  struct NoticeLayer previous[NOTICE_LAYERS_MAX];
+  memcpy(previous, layers, sizeof(layers));
+  bool is_taken[NOTICE_LAYERS_MAX] = {false}; // previous[j] went to a notice or gave it its pixels
+  bool is_kept[NOTICE_LAYERS_MAX] = {false};
+  for (uint8_t k = 0; k < n; k++) {
+    const struct ShownNotice& notice = set.notices[k];
+    for (uint8_t j = 0; j < num_layers; j++) {
+      if (!is_taken[j] && previous[j].id == notice.id && previous[j].pattern == notice.pattern && previous[j].color == notice.color) {
+        layers[k] = previous[j];
+        is_taken[j] = true;
+        is_kept[k] = true;
+        break;
+      }
+    }
+    if (!is_kept[k]) {
+      layers[k].id = notice.id;
+      layers[k].pattern = notice.pattern;
+      layers[k].color = notice.color;
+    }
+  }
+  // every layer keeps one pixels buffer, the ones of layers that were not kept go to the others
+  uint8_t j = 0;
+  for (uint8_t k = 0; k < max_layers; k++) {
+    if (is_kept[k]) {
+      continue;
+    }
+    while (is_taken[j]) {
+      j++;
+    }
+    layers[k].pixels = previous[j].pixels;
+    is_taken[j] = true;
+    if (k < n) {
+      start_layer(layers[k]);
+    }
+  }
+  // nothing shown before or after leaves whatever setup() drew, e.g. the WiFi indicator
+  layout_changed = layout_changed || n > 0 || num_layers > 0;
+  num_layers = n;
+}
+
+
+// writes back_leds from the layers. the ring is split into num_layers segments in order from the origin and each segment shows
+// its layer's whole ring shrunk to fit. the frame's brightness is the brightest layer's and the others are scaled down to theirs.
+// with a single layer the frame is just its pixels rotated by its phase, the same frame as when only one notice could be shown.
+static void composite(void) {
+  bool changed = layout_changed;
+  uint8_t brightness = 0;
+  for (uint8_t k = 0; k < num_layers; k++) {
+    changed = changed || layers[k].changed;
+    if (layers[k].brightness > brightness) {
+      brightness = layers[k].brightness;
+    }
+  }
+  if (!changed) {
+    return;
+  }
+
+  if (num_layers == 0) {
+    fill_solid(back_leds, NUM_LEDS, CRGB::Black);
+    frame_power_mW = 0;
+    frame_power_valid = true;
+  }
+  else if (num_layers == 1) {
+    struct NoticeLayer& layer = layers[0];
+    memcpy(back_leds, layer.pixels + layer.phase, (NUM_LEDS - layer.phase)*sizeof(CRGB));
+    memcpy(back_leds + (NUM_LEDS - layer.phase), layer.pixels, layer.phase*sizeof(CRGB));
+    if (layout_changed || layer.repainted) {
+      // the same pixels in a different order use the same power, so a spin keeps frame_power_mW
+      frame_power_mW = layer.power_mW;
+      frame_power_valid = layer.is_power_known;
+    }
+  }
+  else {
+    for (uint8_t k = 0; k < num_layers; k++) {
+      struct NoticeLayer& layer = layers[k];
+      uint16_t from = ((uint32_t)k*NUM_LEDS)/num_layers;
+      uint16_t length = ((uint32_t)(k+1)*NUM_LEDS)/num_layers - from;
+      uint8_t scale = (brightness > 0) ? ((uint16_t)layer.brightness*255)/brightness : 0;
+      for (uint16_t i = 0; i < length; i++) {
+        uint16_t from_pixel = (idx(((uint32_t)i*NUM_LEDS)/length) + layer.phase) % NUM_LEDS;
+        CRGB pixel = layer.pixels[from_pixel];
+        if (scale < 255) {
+          pixel.nscale8(scale);
+        }
+        back_leds[idx(from + i)] = pixel;
+      }
+    }
+    frame_power_valid = false;
+  }
+  if (!frame_power_valid) {
+    // summed now, after show() swaps the buffers back_leds is no longer this frame
+    frame_power_mW = calculate_unscaled_power_mW(back_leds, NUM_LEDS);
+    frame_power_valid = true;
+  }
+  // does what FastLED's power limiter would do in show(), from the power summed above instead of summing every pixel each frame
+  set_brightness(max_brightness_for_power((num_layers == 0) ? homogenized_brightness : brightness));
+
+  for (uint8_t k = 0; k < num_layers; k++) {
+    layers[k].changed = false;
+    layers[k].repainted = false;
+  }
+  layout_changed = false;
+  mark_frame_dirty();
+}
+
+
+// how long the render task can sleep before it has anything to draw. a layer that changed since it was composited needs the next
+// frame slot, otherwise nothing changes until the soonest animation timer comes due. UINT32_MAX if no timer is running,
+// e.g. only SOLID notices are showing. posting notices and led_output() finishing a frame wake the task on their own.
+uint32_t ms_until_next_redraw(void) {
+  bool changed = layout_changed;
+  for (uint8_t k = 0; k < num_layers; k++) {
+    changed = changed || layers[k].changed;
+  }
+  if (frame_dirty && is_output_busy) {
+    return UINT32_MAX;
+  }
+  if (changed || frame_dirty) {
+    return ms_until_next_frame();
+  }
+  if (!animation_clock.is_due_set) {
+    return UINT32_MAX;
+  }
+  int32_t wait = (int32_t)(animation_clock.next_due_ms - millis());
+  return (wait > 0) ? wait : 0;
+}
+
+
+// rebuilds active_notices if a notice was set or cleared, or events changed, since the last time. returns true if it did.
+static bool refresh_active_notices(void) {
+  if (is_active_notices_built && active_notices_version == notices_version) {
+    return false;
+  }
+  active_notices.clear();
+  for (uint16_t i = 0; i < events.size(); i++) {
+    if (events[i].timestamp != 0) {
+      // if timestamp is 0 then event has not happened since last time notices were cleared
+      // so there is no need to show a visual notice for it
+      active_notices.push_back(i);
+    }
+  }
+  active_notices_version = notices_version;
+  is_active_notices_built = true;
+  return true;
+}
+
+
+// called every pass of loop(). posts the notices to show to the render task when they change, all of them at once if there are
+// max_layers or fewer. otherwise they take turns, NOTICE_SHOW_TIME each, and ms_until_next_turn() says when loop() has to post the next ones.
+void post_visual_notices(void) {
+  bool changed = refresh_active_notices();
+  uint16_t count = active_notices.size();
+  if (count <= max_layers) {
+    first_shown = 0;
+    turn_due_ms = millis() + NOTICE_SHOW_TIME;
+  }
+  else if ((int32_t)(millis() - turn_due_ms) >= 0) {
+    first_shown += max_layers;
+    turn_due_ms = millis() + NOTICE_SHOW_TIME;
+    changed = true;
+  }
+  if (!changed) {
+    return;
+  }
+  if (first_shown >= count) {
+    first_shown = 0;
+  }
+
+  struct NoticeSet& set = notice_sets[posting_set];
+  set.count = (count < max_layers) ? count : max_layers;
+  for (uint8_t k = 0; k < set.count; k++) {
+    const struct Event& event = events[active_notices[(first_shown + k) % count]];
+    set.notices[k].id = event.id;
+    resolve_notice(event, &set.notices[k].pattern, &set.notices[k].color);
+  }
+  posting_set = notice_mailbox.exchange(posting_set | NOTICES_POSTED) & ~NOTICES_POSTED;
+  uint8_t wake = 0;
+  xQueueSend(qrender_wakes, &wake, 0);
+}
+
+
+// how long loop() can wait before post_visual_notices() has to post the next notices in turn. UINT32_MAX if they are not taking turns.
+uint32_t ms_until_next_turn(void) {
+  if (active_notices.size() <= max_layers) {
+    return UINT32_MAX;
+  }
+  int32_t wait = (int32_t)(turn_due_ms - millis());
+  return (wait > 0) ? wait : 0;
+}
+
+
+// one pass of the render task. draws every notice posted into its layer, composites the layers when show() has a frame slot
+// so all of them are on the ring at once, and hands the frame to led_output(). returns how long the task can sleep.
+uint32_t render_notices(void) {
+  uint32_t start = micros();
+  animation_clock.now = millis();
+  animation_clock.is_due_set = false;
+  const struct NoticeSet* set = take_notices();
+  if (set != nullptr) {
+    assign_layers(*set);
+  }
+
+  for (uint8_t k = 0; k < num_layers; k++) {
+    struct NoticeLayer& layer = layers[k];
+    // for DEBUGGING
+    //if (layer.refill) {
+    //  DEBUG_PRINT("id: ");
+    //  DEBUG_PRINTLN(layer.id);
+    //  DEBUG_PRINT("pattern: ");
+    //  DEBUG_PRINTLN(layer.pattern ? layer.pattern->name : "none");
+
+    //  DEBUG_PRINT("color: ");
+    //  char hex_color[11];
+    //  snprintf(hex_color, sizeof(hex_color), "0x%08lX", layer.color);
+    //  DEBUG_PRINTLN(hex_color);
+    //}
+    if (layer.pattern != nullptr) {
+      layer.pattern->draw(layer);
+    }
+    layer.refill = false;
+  }
+
+  if (ms_until_next_frame() == 0) {
+    composite();
+  }
+  show();
+  render_stats.render_us = micros() - start;
+  if (render_stats.render_us > render_stats.render_us_max) {
+    render_stats.render_us_max = render_stats.render_us;
+  }
+  return ms_until_next_redraw();
+}
+
+
+// the render task. main.cpp starts it with xTaskCreatePinnedToCore() on RENDER_TASK_CORE.
+void visual_notifier(void* parameter) {
+  uint8_t wake;
+  for (;;) {
+    uint32_t wait_ms = render_notices();
+    // at least a tick so loop() on the same core is never starved
+    wait_ms = (wait_ms > 0) ? wait_ms : 1;
+    xQueueReceive(qrender_wakes, &wake, (wait_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms));
+  }
+  vTaskDelete(NULL);
+}
+
+
+// sends the frames show() hands over. FastLED.show() waits for the strip to be written, only this task waits with it.
+// main.cpp starts it before visual_notifier(), until then show() sends frames itself.
+void led_output(void* parameter) {
+  is_output_running = true;
+  struct OutputFrame frame;
+  for (;;) {
+    if (xQueueReceive(qoutput_frames, &frame, portMAX_DELAY) == pdTRUE) {
+      send_frame(frame);
+      is_output_busy = false;
+      uint8_t wake = 0;
+      xQueueSend(qrender_wakes, &wake, 0);
+    }
+  }
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,1064 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <Preferences.h>
+
+#include "audio_queue.h"
+#include "storage.h"
+
+EventTable event_table;
+std::vector<Event>& events = event_table.events;
+std::vector<uint16_t>& schedule = event_table.schedule;
+time_t (*scheduler_clock)(time_t* t) = time;
+std::vector<char>& event_strings = event_table.strings;
+std::vector<uint32_t>& interned_strings = event_table.interned;
+time_t scheduler_watermark = 0;
+uint32_t notices_version = 0;
+
+// ids /event/update and /event/delete accept, one bit per id. the web server may not touch the events table, so it checks these instead.
+// they are the ids in the live table plus the ones changes were queued for since. guarded by event_ids_lock.
+static std::vector<uint32_t> event_id_bits;
+static SemaphoreHandle_t event_ids_lock = NULL;
+
+// only loop() may touch the events table, so /upcoming.json reads a copy of the next occurrences that refresh_upcoming() keeps.
+// the list is only rebuilt when schedule_version changed, and the web server only ever waits for the copy under upcoming_lock.
+static uint32_t schedule_version = 0; // changes whenever the live schedule does
+static uint32_t upcoming_version = UINT32_MAX; // schedule_version when upcoming_list was built, loop() only
+static Occurrence upcoming_building[UPCOMING_MAX]; // loop() only
+static Occurrence upcoming_list[UPCOMING_MAX];
+static uint16_t upcoming_count = 0;
+static SemaphoreHandle_t upcoming_lock = NULL;
+
+// UTC offsets of the TZ in effect, see tz_table_rebuild(). each entry holds from its instant until the next one.
+struct TzTransition {
+  time_t at;
+  int32_t offset; // seconds east of UTC, the opposite sign of the POSIX TZ string
+  bool is_dst;
+};
+static std::vector<TzTransition> tz_transitions;
+static time_t tz_table_end = 0;
+
+static time_t mktime_local(int32_t day, int32_t time_of_day);
+
+
+void fill_in_datetime(tm* _datetime) {
+//#if defined DEBUG_CONSOLE
+//  char buffer[100];
+//  // missing timezone and empty parenthesis indicate _datetime->tm_isdst is -1
+//  strftime(buffer, sizeof(buffer), "%a %Y/%m/%d %H:%M:%S %Z (%z)", _datetime);
+//  DEBUG_PRINTF("\nfill_in_datetime() before: %s\n", buffer);
+//#endif
+
+  // the fields may be out of range, e.g. tm_sec + 25, so the date is normalized through days since the epoch the same way mktime() does.
+  // tm_isdst is always treated as -1.
+  int32_t y = _datetime->tm_year + 1900 + _datetime->tm_mon / 12;
+  int32_t mon = _datetime->tm_mon % 12;
+  if (mon < 0) {
+    mon += 12;
+    y--;
+  }
+  int64_t local = (int64_t)(days_from_civil(y, mon + 1, 1) + _datetime->tm_mday - 1)*86400
+                  + _datetime->tm_hour*3600 + _datetime->tm_min*60 + _datetime->tm_sec;
+  time_t t = local_seconds_to_epoch(local);
+  epoch_to_tm(t, _datetime); // tm_wday, tm_yday, and tm_isdst are filled in with the proper values
+
+//#if defined DEBUG_CONSOLE
+//  strftime(buffer, sizeof(buffer), "%a %Y/%m/%d %H:%M:%S %Z (%z)", _datetime);
+//  DEBUG_PRINTF("fill_in_datetime() after: %s\n", buffer);
+//#endif
+}
+
+
+tm new_time(uint32_t value, char unit) {
+  struct tm next_event = {0};
+  time_t now;
+  scheduler_clock(&now);
+  epoch_to_tm(now, &next_event);
+
+  next_event.tm_isdst = -1; // A negative value of tm_isdst causes mktime to attempt to determine if Daylight Saving Time was in effect in the specified time. 
+
+  bool updated = false;
+  switch(unit) {
+    case 's':
+      next_event.tm_sec += value;
+      break;
+    case 'm':
+      next_event.tm_min += value;
+      break;
+    case 'h':
+      next_event.tm_hour += value;
+      break;
+    case 'd':
+      next_event.tm_mday += 1;
+      break;
+    default:
+      break;
+  }
+  fill_in_datetime(&next_event);
+
+  return next_event;
+}
+
+
+// the recurrence engine works on local calendar days counted from 1970-01-01 so the next occurrence of a rule
+// can be calculated directly instead of stepping struct tm values through mktime() until they land in the future.
+// days_from_civil() and civil_from_days() are based on Howard Hinnant's public domain date algorithms
+// https://howardhinnant.github.io/date_algorithms.html
+int32_t days_from_civil(int32_t y, uint8_t m, uint8_t d) {
+  y -= (m <= 2);
+  const int32_t era = (y >= 0 ? y : y - 399) / 400;
+  const uint32_t yoe = (uint32_t)(y - era * 400); // [0, 399]
+  const uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1; // [0, 365]
+  const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy; // [0, 146096]
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+
+void civil_from_days(int32_t z, int32_t* y, uint8_t* m, uint8_t* d) {
+  z += 719468;
+  const int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+  const uint32_t doe = (uint32_t)(z - era * 146097); // [0, 146096]
+  const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365; // [0, 399]
+  const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100); // [0, 365]
+  const uint32_t mp = (5 * doy + 2) / 153; // [0, 11]
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = mp < 10 ? mp + 3 : mp - 9;
+  *y = (int32_t)yoe + era * 400 + (*m <= 2);
+}
+
+
+// 0 is Sunday, the same as tm_wday. 1970-01-01 was a Thursday.
+uint8_t weekday_from_days(int32_t z) {
+  return (z >= -4) ? (z + 4) % 7 : (z + 5) % 7 + 6;
+}
+
+
+uint8_t days_in_month(int32_t y, uint8_t m) {
+  static const uint8_t dim[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  if (m == 2 && (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0))) {
+    return 29;
+  }
+  return dim[m-1];
+}
+
+
+// returns the first day on or after from_day that the rule occurs on in month y-m, or NO_OCCURRENCE.
+int32_t occurrence_in_month(const Recurrence& rule, uint8_t start_mday, int32_t y, uint8_t m, int32_t from_day) {
+  int32_t first = days_from_civil(y, m, 1);
+  int32_t last = first + days_in_month(y, m) - 1;
+  if (rule.nth == 0) {
+    // same day of the month as the start date. months without that day (e.g. the 31st) are skipped
+    // and so are months where that day falls on an excluded weekday.
+    int32_t day = first + start_mday - 1;
+    if (day > last || day < from_day || (rule.exclude & (1 << weekday_from_days(day)))) {
+      return NO_OCCURRENCE;
+    }
+    return day;
+  }
+
+  const uint8_t by_day = rule.by_day & ~rule.exclude;
+  int32_t best = NO_OCCURRENCE;
+  for (uint8_t wd = 0; wd < 7; wd++) {
+    if ((by_day & (1 << wd)) == 0) {
+      continue;
+    }
+    int32_t day;
+    if (rule.nth > 0) {
+      day = first + (wd + 7 - weekday_from_days(first)) % 7 + 7*(rule.nth - 1);
+    }
+    else {
+      day = last - (weekday_from_days(last) + 7 - wd) % 7;
+    }
+    if (day <= last && day >= from_day && day < best) {
+      best = day;
+    }
+  }
+  return best;
+}
+
+
+// returns the first day on or after from_day that the rule occurs on, or NO_OCCURRENCE if it never occurs again.
+// every branch does a fixed amount of work no matter how far from_day is from the start date.
+// excluded weekdays are skipped here rather than when the event is due, so every occurrence that is scheduled actually fires.
+int32_t next_occurrence_day(const Recurrence& rule, int32_t from_day) {
+  if (rule.frequency == 'o') {
+    if (rule.exclude & (1 << weekday_from_days(rule.start_day))) {
+      return NO_OCCURRENCE;
+    }
+    return (rule.start_day >= from_day) ? rule.start_day : NO_OCCURRENCE;
+  }
+
+  if (from_day < rule.start_day) {
+    from_day = rule.start_day;
+  }
+  const int32_t interval = (rule.interval > 0) ? rule.interval : 1;
+
+  if (rule.frequency == 'd') {
+    int32_t k = from_day - rule.start_day;
+    k = ((k + interval - 1) / interval) * interval;
+    // the weekdays of the occurrences repeat at least every 7 occurrences,
+    // so if none of the next 7 are on an allowed weekday none ever will be.
+    for (uint8_t tries = 0; tries < 7; tries++, k += interval) {
+      if ((rule.exclude & (1 << weekday_from_days(rule.start_day + k))) == 0) {
+        return rule.start_day + k;
+      }
+    }
+    return NO_OCCURRENCE;
+  }
+
+  if (rule.frequency == 'w') {
+    const uint8_t by_day = rule.by_day & ~rule.exclude;
+    if (by_day == 0) {
+      return NO_OCCURRENCE;
+    }
+    // weeks start on Sunday and are counted from the week containing the start date
+    const int32_t week0 = rule.start_day - weekday_from_days(rule.start_day);
+    int32_t week = (from_day - week0) / 7;
+    if (week % interval != 0) {
+      week += interval - (week % interval);
+      from_day = week0 + 7*week;
+    }
+    // if the current week has no match the next active week always does
+    for (uint8_t tries = 0; tries < 2; tries++) {
+      for (int32_t day = from_day; day < week0 + 7*(week + 1); day++) {
+        if (by_day & (1 << weekday_from_days(day))) {
+          return day;
+        }
+      }
+      week += interval;
+      from_day = week0 + 7*week;
+    }
+    return NO_OCCURRENCE;
+  }
+
+  if (rule.frequency == 'm' || rule.frequency == 'y') {
+    int32_t sy, fy;
+    uint8_t sm, sd, fm, fd;
+    civil_from_days(rule.start_day, &sy, &sm, &sd);
+    civil_from_days(from_day, &fy, &fm, &fd);
+    const int32_t step = (rule.frequency == 'y') ? 12*interval : interval;
+    const int32_t start_month = 12*sy + (sm - 1);
+    int32_t k = (12*fy + (fm - 1)) - start_month;
+    if (k % step != 0) {
+      k += step - (k % step);
+    }
+    // a few months may need to be skipped, e.g. the 31st, the 5th Friday of a month, or a day of the month on an excluded weekday.
+    // a yearly event on Feb 29 is the worst case and needs up to 8 years (2096 -> 2104), and a few decades if some weekdays are excluded.
+    for (uint8_t tries = 0; tries < MAX_MONTHS_SEARCHED; tries++, k += step) {
+      int32_t month = start_month + k;
+      int32_t day = occurrence_in_month(rule, sd, month / 12, (month % 12) + 1, from_day);
+      if (day != NO_OCCURRENCE) {
+        return day;
+      }
+    }
+  }
+
+  return NO_OCCURRENCE;
+}
+
+
+// newlib re-evaluates the POSIX TZ rules on every mktime() and localtime_r() call, which made them most of the cost of rescheduling.
+// the offsets for the years around now are worked out once instead, and conversions are a binary search of tz_transitions.
+// the transitions are found by asking localtime_r() rather than parsing TZ again, so they agree with it exactly.
+// times outside the table still go through mktime() and localtime_r().
+static bool probe_offset(time_t t, int32_t* offset, bool* is_dst) {
+  struct tm local = {0};
+  if (localtime_r(&t, &local) == NULL) {
+    return false;
+  }
+  int64_t local_seconds = (int64_t)days_from_civil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday)*86400 + local.tm_hour*3600 + local.tm_min*60 + local.tm_sec;
+  *offset = (int32_t)(local_seconds - t);
+  *is_dst = local.tm_isdst > 0;
+  return true;
+}
+
+
+// call after TZ is set. TZ only changes at boot, so that is the only time it is needed on the ESP32.
+// the table covers January 1st of the year before around until January 1st TZ_TABLE_YEARS after it, around is normally now.
+void tz_table_rebuild(time_t around) {
+  tz_transitions.clear();
+  tz_table_end = 0;
+
+  int32_t y;
+  uint8_t m, d;
+  civil_from_days((int32_t)(around / 86400), &y, &m, &d);
+  const time_t start = (time_t)days_from_civil(y - 1, 1, 1)*86400;
+  const time_t end = (time_t)days_from_civil(y + TZ_TABLE_YEARS, 1, 1)*86400;
+
+  struct TzTransition last;
+  last.at = start;
+  if (!probe_offset(start, &last.offset, &last.is_dst)) {
+    return;
+  }
+  tz_transitions.push_back(last);
+
+  // DST rules never change the offset twice in a week, so checking once a week and bisecting finds every transition
+  const time_t step = 7*86400;
+  for (time_t t = start; t < end; t += step) {
+    time_t hi = std::min(t + step, end);
+    struct TzTransition next;
+    if (!probe_offset(hi, &next.offset, &next.is_dst)) {
+      tz_transitions.clear();
+      return;
+    }
+    if (next.offset == last.offset && next.is_dst == last.is_dst) {
+      continue;
+    }
+    time_t lo = t; // lo has the old offset, hi has the new one
+    while (hi - lo > 1) {
+      time_t mid = lo + (hi - lo)/2;
+      int32_t offset;
+      bool is_dst;
+      probe_offset(mid, &offset, &is_dst);
+      if (offset == last.offset && is_dst == last.is_dst) {
+        lo = mid;
+      }
+      else {
+        hi = mid;
+      }
+    }
+    next.at = hi;
+    tz_transitions.push_back(next);
+    last = next;
+  }
+  tz_table_end = end;
+  DEBUG_PRINTF("time zone table: %u transitions\n", (unsigned)tz_transitions.size());
+}
+
+
+// index in tz_transitions of the offset in effect at t, or -1 if t is outside the table
+static int32_t tz_index(time_t t) {
+  if (tz_transitions.empty() || t < tz_transitions.front().at || t >= tz_table_end) {
+    return -1;
+  }
+  std::vector<TzTransition>::const_iterator it = std::upper_bound(tz_transitions.begin(), tz_transitions.end(), t,
+                                                                  [](time_t t, const TzTransition& tr) { return t < tr.at; });
+  return (it - tz_transitions.begin()) - 1;
+}
+
+
+// true if local - offset of transition i falls in the time that transition i covers
+static bool tz_covers(int32_t i, int64_t local) {
+  time_t t = local - tz_transitions[i].offset;
+  return t >= tz_transitions[i].at && (i + 1 == (int32_t)tz_transitions.size() ? t < tz_table_end : t < tz_transitions[i+1].at);
+}
+
+
+// local seconds since 1970-01-01 00:00 to seconds since the Unix Epoch, like mktime() with tm_isdst set to -1.
+// a local time that happens twice when DST ends or is skipped when DST begins uses standard time, the same choice newlib makes.
+time_t local_seconds_to_epoch(int64_t local) {
+  int32_t i = tz_index(local - (tz_transitions.empty() ? 0 : tz_transitions.front().offset));
+  if (i >= 0) {
+    // the offset that applies is the one at i or a neighbour, offsets only change a few hours at a time
+    int32_t found = -1;
+    for (int32_t j = std::max(i - 1, 0); j <= std::min(i + 1, (int32_t)tz_transitions.size() - 1); j++) {
+      if (tz_covers(j, local) && (found < 0 || tz_transitions[found].is_dst)) {
+        found = j;
+      }
+    }
+    if (found >= 0) {
+      return local - tz_transitions[found].offset;
+    }
+    // skipped when DST began, one of the offsets on either side of the transition is standard time
+    for (int32_t j = std::max(i - 1, 0); j <= std::min(i + 1, (int32_t)tz_transitions.size() - 1); j++) {
+      if (!tz_transitions[j].is_dst) {
+        return local - tz_transitions[j].offset;
+      }
+    }
+  }
+
+  int32_t day = (int32_t)(local >= 0 ? local / 86400 : (local - 86399) / 86400);
+  return mktime_local(day, (int32_t)(local - (int64_t)day*86400));
+}
+
+
+// seconds since the Unix Epoch to local days since 1970-01-01 and seconds since midnight, like localtime_r().
+void epoch_to_local(time_t t, int32_t* day, int32_t* time_of_day) {
+  int32_t i = tz_index(t);
+  if (i < 0) {
+    struct tm local = {0};
+    localtime_r(&t, &local);
+    *day = days_from_civil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday);
+    *time_of_day = local.tm_hour*3600 + local.tm_min*60 + local.tm_sec;
+    return;
+  }
+  int64_t local = (int64_t)t + tz_transitions[i].offset;
+  *day = (int32_t)(local >= 0 ? local / 86400 : (local - 86399) / 86400);
+  *time_of_day = (int32_t)(local - (int64_t)*day*86400);
+}
+
+
+// localtime_r() through the table
+void epoch_to_tm(time_t t, tm* datetime) {
+  int32_t i = tz_index(t);
+  if (i < 0) {
+    localtime_r(&t, datetime);
+    return;
+  }
+  int32_t day, time_of_day;
+  epoch_to_local(t, &day, &time_of_day);
+  int32_t y;
+  uint8_t m, d;
+  civil_from_days(day, &y, &m, &d);
+  datetime->tm_year = y - 1900;
+  datetime->tm_mon = m - 1;
+  datetime->tm_mday = d;
+  datetime->tm_hour = time_of_day / 3600;
+  datetime->tm_min = (time_of_day / 60) % 60;
+  datetime->tm_sec = time_of_day % 60;
+  datetime->tm_wday = weekday_from_days(day);
+  datetime->tm_yday = day - days_from_civil(y, 1, 1);
+  datetime->tm_isdst = tz_transitions[i].is_dst ? 1 : 0;
+}
+
+
+// local date and time of day to seconds since the Unix Epoch.
+// the DST rules settle whether DST is in effect, so the wall clock time of an occurrence is the same on both sides of a DST change.
+time_t local_to_epoch(int32_t day, int32_t time_of_day) {
+  return local_seconds_to_epoch((int64_t)day*86400 + time_of_day);
+}
+
+
+// local_to_epoch() for times outside the time zone table
+static time_t mktime_local(int32_t day, int32_t time_of_day) {
+  struct tm datetime = {0};
+  int32_t y;
+  uint8_t m, d;
+  civil_from_days(day, &y, &m, &d);
+  datetime.tm_year = y - 1900;
+  datetime.tm_mon = m - 1;
+  datetime.tm_mday = d;
+  datetime.tm_hour = time_of_day / 3600;
+  datetime.tm_min = (time_of_day / 60) % 60;
+  datetime.tm_sec = time_of_day % 60;
+  datetime.tm_isdst = -1; // A negative value of tm_isdst causes mktime to attempt to determine if Daylight Saving Time was in effect in the specified time.
+  return mktime(&datetime);
+}
+
+
+// true if t is at or after the end date and time of rule.
+static bool is_past_end(const Recurrence& rule, time_t t) {
+  return rule.end_day != NO_OCCURRENCE && t >= local_to_epoch(rule.end_day, rule.end_time_of_day);
+}
+
+
+// returns the first occurrence of rule after the given time as seconds since the Unix Epoch or 0 (the Unix Epoch) if it never occurs again.
+// occurrences at or after the end date count as never, so rescheduling after an event fires stops at the end date too.
+time_t next_fire_after(const Recurrence& rule, time_t after) {
+  int32_t today, after_time_of_day;
+  epoch_to_local(after, &today, &after_time_of_day);
+  int32_t day = next_occurrence_day(rule, (rule.time_of_day > after_time_of_day) ? today : today + 1);
+  if (day == NO_OCCURRENCE) {
+    return 0;
+  }
+
+  time_t t = local_to_epoch(day, rule.time_of_day);
+  if (t <= after) {
+    // only possible during the hour that repeats when DST ends
+    day = next_occurrence_day(rule, day + 1);
+    if (day == NO_OCCURRENCE) {
+      return 0;
+    }
+    t = local_to_epoch(day, rule.time_of_day);
+  }
+  if (is_past_end(rule, t)) {
+    return 0;
+  }
+  return t;
+}
+
+
+// returns the next occurrence of rule after now as seconds since the Unix Epoch or 0 (the Unix Epoch) if it never occurs again.
+time_t refresh_datetime(const Recurrence& rule) {
+  time_t now;
+  scheduler_clock(&now);
+  return next_fire_after(rule, now);
+}
+
+
+void reschedule(Event& event) {
+  event.next_fire = refresh_datetime(event.rule);
+}
+
+
+// events loaded at boot are scheduled from here instead of from now, so the occurrences missed while the device was off
+// are already due and check_for_recent_events() deals with them.
+time_t catch_up_from(void) {
+  time_t now;
+  scheduler_clock(&now);
+  if (scheduler_watermark <= 0 || scheduler_watermark > now) {
+    // first boot, or the clock went backwards
+    return now;
+  }
+  return std::max(scheduler_watermark, now - MISSED_EVENTS_MAX_AGE);
+}
+
+
+void load_scheduler_watermark(void) {
+  Preferences nvs;
+  nvs.begin("scheduler", true);
+  scheduler_watermark = nvs.getLong64("watermark", 0);
+  nvs.end();
+  DEBUG_PRINTF("scheduler watermark: %lld\n", (long long)scheduler_watermark);
+}
+
+
+// flash wears out, so this is only called when an occurrence was handled.
+// the checks in between find nothing due, so an older watermark in NVS still covers them.
+static void save_scheduler_watermark(void) {
+  Preferences nvs;
+  nvs.begin("scheduler", false);
+  nvs.putLong64("watermark", scheduler_watermark);
+  nvs.end();
+}
+
+
+// next_fire may be in the past when it was caught up from the watermark, so only 0 means it never occurs again.
+bool is_expired(time_t next_fire, const Recurrence& rule) {
+  time_t tdt = next_fire;
+
+  if (tdt == 0) {
+    DEBUG_PRINTLN("expired: no more occurrences\n");
+    return true;
+  }
+
+  if (is_past_end(rule, tdt)) {
+    DEBUG_PRINTLN("expired: after end date\n");
+    return true;
+  }
+
+  return false;
+}
+
+
+uint16_t new_id(bool reset) {
+  if (reset) {
+    event_table.next_id = 0;
+    return 0;
+  }
+  uint16_t id = event_table.next_id.fetch_add(1);
+  assert(id != UINT16_MAX); // if false, rolled over. this many events is not supported.
+  return id;
+}
+
+
+// ids are stored in events.json, so new_id() has to skip past every id already in the file.
+// this includes expired events that never make it into the events table.
+// compare_exchange_weak() reloads next when it fails, so an id handed out by new_id() in between is never taken back.
+void reserve_id(uint16_t id, EventTable& table) {
+  uint16_t next = table.next_id;
+  while (id >= next) {
+    assert(id != UINT16_MAX);
+    if (table.next_id.compare_exchange_weak(next, id + 1)) {
+      break;
+    }
+  }
+}
+
+
+// creates the locks shared with the web server. called from setup() before the events are loaded and the web server is started.
+void scheduler_setup(void) {
+  event_ids_lock = xSemaphoreCreateMutex();
+  upcoming_lock = xSemaphoreCreateMutex();
+}
+
+
+bool is_event_id_known(uint16_t id) {
+  xSemaphoreTake(event_ids_lock, portMAX_DELAY);
+  bool is_known = id/32 < event_id_bits.size() && (event_id_bits[id/32] & (1UL << (id % 32))) != 0;
+  xSemaphoreGive(event_ids_lock);
+  return is_known;
+}
+
+
+// called by queue_event_change() when a change is queued and again by apply_event_changes() when it is applied,
+// since a reload may have swapped in a table without the change in between.
+void set_event_id_known(uint16_t id, bool is_known) {
+  xSemaphoreTake(event_ids_lock, portMAX_DELAY);
+  if (id/32 >= event_id_bits.size()) {
+    event_id_bits.resize(id/32 + 1, 0);
+  }
+  if (is_known) {
+    event_id_bits[id/32] |= 1UL << (id % 32);
+  }
+  else {
+    event_id_bits[id/32] &= ~(1UL << (id % 32));
+  }
+  xSemaphoreGive(event_ids_lock);
+}
+
+
+// the bits are built outside the lock, so the web server only waits for the swap
+static void rebuild_event_ids(void) {
+  std::vector<uint32_t> bits((event_table.next_id + 31)/32, 0);
+  for (const Event& event : event_table.events) {
+    bits[event.id/32] |= 1UL << (event.id % 32);
+  }
+  xSemaphoreTake(event_ids_lock, portMAX_DELAY);
+  event_id_bits.swap(bits);
+  xSemaphoreGive(event_ids_lock);
+}
+
+
+// returns the index of the event with the given id in events or -1 if there is none.
+int32_t event_index(uint16_t id, const EventTable& table) {
+  if (id >= table.indices.size() || table.indices[id] == NO_INDEX) {
+    return -1;
+  }
+  return table.indices[id];
+}
+
+
+// std::make_heap() builds a max-heap, so the comparison is reversed to keep the soonest event on top.
+struct ScheduleCompare {
+  const std::vector<Event>& events;
+  bool operator()(uint16_t a, uint16_t b) const {
+    return events[a].next_fire > events[b].next_fire;
+  }
+};
+
+
+// the std heap functions cannot say where they moved an event, so the schedule is kept in order here instead.
+// the heap is laid out the way the std functions lay it out, so std::make_heap() in schedule_rebuild() and these can be mixed.
+static void schedule_place(EventTable& table, uint16_t position, uint16_t index) {
+  table.schedule[position] = index;
+  table.positions[index] = position;
+}
+
+
+static void sift_up(EventTable& table, uint16_t position) {
+  uint16_t index = table.schedule[position];
+  time_t next_fire = table.events[index].next_fire;
+  while (position > 0) {
+    uint16_t parent = (position - 1)/2;
+    if (table.events[table.schedule[parent]].next_fire <= next_fire) {
+      break;
+    }
+    schedule_place(table, position, table.schedule[parent]);
+    position = parent;
+  }
+  schedule_place(table, position, index);
+}
+
+
+static void sift_down(EventTable& table, uint16_t position) {
+  uint16_t index = table.schedule[position];
+  time_t next_fire = table.events[index].next_fire;
+  uint32_t size = table.schedule.size();
+  while (true) {
+    uint32_t child = 2*(uint32_t)position + 1;
+    if (child >= size) {
+      break;
+    }
+    if (child + 1 < size && table.events[table.schedule[child + 1]].next_fire < table.events[table.schedule[child]].next_fire) {
+      child++;
+    }
+    if (table.events[table.schedule[child]].next_fire >= next_fire) {
+      break;
+    }
+    schedule_place(table, position, table.schedule[child]);
+    position = child;
+  }
+  schedule_place(table, position, index);
+}
+
+
+// after the next_fire of events[index] changed. it is taken out of the schedule when it no longer occurs.
+static void schedule_update(uint16_t index, EventTable& table) {
+  uint16_t position = table.positions[index];
+  if (position == NO_INDEX) {
+    if (table.events[index].next_fire > 0) {
+      schedule_push(index, table);
+    }
+    return;
+  }
+  if (table.events[index].next_fire == 0) {
+    schedule_remove(index, table);
+    return;
+  }
+  sift_up(table, position);
+  sift_down(table, table.positions[index]);
+}
+
+
+// replaces the event with the same id or appends it when the id is new. event must already be rescheduled.
+// only the changed event is moved in the schedule, O(log n) in the number of events.
+void put_event(const Event& event, EventTable& table) {
+  int32_t i = event_index(event.id, table);
+  if (i < 0) {
+    if (event.id >= table.indices.size()) {
+      table.indices.resize(event.id + 1, NO_INDEX);
+    }
+    table.indices[event.id] = table.events.size();
+    table.events.push_back(event);
+    table.positions.push_back(NO_INDEX);
+    if (event.next_fire > 0) {
+      schedule_push(table.events.size() - 1, table);
+    }
+    return;
+  }
+  table.events[i] = event;
+  schedule_update(i, table);
+  if (&table == &event_table) {
+    schedule_version++;
+    notices_version++;
+  }
+}
+
+
+// the last event is moved into the hole instead of erasing from the middle of events, so nothing else has to be renumbered.
+// that changes the order of events, which is only the order notices are shown in.
+bool remove_event(uint16_t id, EventTable& table) {
+  int32_t i = event_index(id, table);
+  if (i < 0) {
+    return false;
+  }
+  if (table.positions[i] != NO_INDEX) {
+    schedule_remove(i, table);
+  }
+  table.indices[id] = NO_INDEX;
+  uint16_t last = table.events.size() - 1;
+  if (i != last) {
+    table.events[i] = table.events[last];
+    table.positions[i] = table.positions[last];
+    if (table.positions[i] != NO_INDEX) {
+      table.schedule[table.positions[i]] = i;
+    }
+    table.indices[table.events[i].id] = i;
+  }
+  table.events.pop_back();
+  table.positions.pop_back();
+  if (&table == &event_table) {
+    schedule_version++;
+    notices_version++; // the renderer's indices are no longer valid
+  }
+  return true;
+}
+
+
+// next_fire is the heap's key, so it must not be changed while the event is in the heap.
+// check_for_recent_events() removes an event before moving next_fire and pushes it back afterwards.
+void schedule_push(uint16_t index, EventTable& table) {
+  table.schedule.push_back(index);
+  sift_up(table, table.schedule.size() - 1);
+  if (&table == &event_table) {
+    schedule_version++;
+  }
+}
+
+
+void schedule_remove(uint16_t index, EventTable& table) {
+  uint16_t position = table.positions[index];
+  table.positions[index] = NO_INDEX;
+  uint16_t last = table.schedule.back();
+  table.schedule.pop_back();
+  if (position < table.schedule.size()) {
+    schedule_place(table, position, last);
+    sift_up(table, position);
+    sift_down(table, table.positions[last]);
+  }
+  if (&table == &event_table) {
+    schedule_version++;
+  }
+}
+
+
+// the heap stores indices into events, so it has to be rebuilt whenever events is reloaded or an event is erased.
+// positions and indices are rebuilt along with it.
+void schedule_rebuild(EventTable& table) {
+  table.schedule.clear();
+  table.schedule.reserve(table.events.size());
+  uint16_t max_id = 0;
+  for (uint16_t i = 0; i < table.events.size(); i++) {
+    if (table.events[i].next_fire > 0) {
+      // events set to the Unix Epoch by refresh_datetime() no longer occur, so they do not need to be scheduled
+      table.schedule.push_back(i);
+    }
+    max_id = std::max(max_id, table.events[i].id);
+  }
+  std::make_heap(table.schedule.begin(), table.schedule.end(), ScheduleCompare{table.events});
+
+  table.positions.assign(table.events.size(), NO_INDEX);
+  for (uint16_t position = 0; position < table.schedule.size(); position++) {
+    table.positions[table.schedule[position]] = position;
+  }
+  table.indices.assign(table.events.empty() ? 0 : max_id + 1, NO_INDEX);
+  for (uint16_t i = 0; i < table.events.size(); i++) {
+    table.indices[table.events[i].id] = i;
+  }
+  if (&table == &event_table) {
+    schedule_version++;
+  }
+}
+
+
+static bool is_same_rule(const Recurrence& a, const Recurrence& b) {
+  return a.start_day == b.start_day && a.time_of_day == b.time_of_day && a.end_day == b.end_day && a.end_time_of_day == b.end_time_of_day
+         && a.frequency == b.frequency && a.interval == b.interval && a.by_day == b.by_day && a.exclude == b.exclude && a.nth == b.nth;
+}
+
+
+// the strings are compared rather than their offsets, the offsets differ between tables.
+// a random sound is replaced every time the event occurs, so it is not compared.
+static bool is_same_event(const Event& a, const EventTable& table_a, const Event& b, const EventTable& table_b) {
+  return is_same_rule(a.rule, b.rule) && a.color == b.color && a.pattern == b.pattern && a.priority == b.priority && a.is_random_sound == b.is_random_sound
+         && strcmp(event_description(a, table_a), event_description(b, table_b)) == 0
+         && (a.is_random_sound || strcmp(event_sound(a, table_a), event_sound(b, table_b)) == 0)
+         && strcmp(event_voice(a, table_a), event_voice(b, table_b)) == 0;
+}
+
+
+// makes table the live event table. each vector is swapped, which only exchanges pointers, and the old table is left in table.
+// must be called from loop(), the same as post_visual_notices(), check_for_recent_events(), and the button handlers.
+void swap_event_table(EventTable& table) {
+  // a notice that has not been cleared yet stays up if its event did not change.
+  // only events with a notice are looked up, so this is cheap unless many notices are waiting.
+  for (const Event& old_event : event_table.events) {
+    if (old_event.timestamp == 0) {
+      continue;
+    }
+    int32_t i = event_index(old_event.id, table);
+    if (i >= 0 && is_same_event(table.events[i], table, old_event, event_table)) {
+      table.events[i].timestamp = old_event.timestamp;
+    }
+  }
+
+  // check_for_recent_events() kept handling the old table while this one was built, those occurrences must not happen again
+  bool rescheduled = false;
+  for (Event& event : table.events) {
+    if (event.next_fire != 0 && event.next_fire <= scheduler_watermark) {
+      event.next_fire = next_fire_after(event.rule, scheduler_watermark);
+      rescheduled = true;
+    }
+  }
+  if (rescheduled) {
+    schedule_rebuild(table);
+  }
+
+  // the web server may have handed out ids while the table was built, and may be handing one out right now,
+  // so the new table's next_id is folded into the live one instead of being swapped in
+  if (table.next_id > 0) {
+    reserve_id(table.next_id - 1);
+  }
+
+  event_table.events.swap(table.events);
+  event_table.schedule.swap(table.schedule);
+  event_table.positions.swap(table.positions);
+  event_table.indices.swap(table.indices);
+  event_table.strings.swap(table.strings);
+  event_table.interned.swap(table.interned);
+  rebuild_event_ids();
+  notices_version++;
+  schedule_version++;
+}
+
+
+// the next_fire of the soonest event or 0 if nothing is scheduled. main.cpp arms its event timer for this time.
+time_t next_scheduled_fire(void) {
+  return schedule.empty() ? 0 : events[schedule.front()].next_fire;
+}
+
+
+// queues the visual and aural notices of the occurrence of events[i] at due.
+static void notify(uint16_t i, time_t due, bool do_long_notify) {
+  events[i].timestamp = due;
+  notices_version++;
+  struct AudioMessage audio_message = {events[i].id, "", "", "", events[i].timestamp, do_long_notify, events[i].priority};
+  snprintf(audio_message.description, sizeof(audio_message.description), "%s", event_description(events[i]));
+
+  snprintf(audio_message.sound, sizeof(audio_message.sound), "%s", event_sound(events[i]));
+  if (events[i].is_random_sound) {
+    // events[i].sound is overwritten because want single_click_handler()
+    // to be able to replay the same random song
+    // there is a fixed set of sound files, so interning them does not grow the arena every time the event occurs
+    set_random_sound(audio_message.sound, sizeof(audio_message.sound));
+    events[i].sound = intern_event_string(audio_message.sound, SOUND_SIZE);
+  }
+
+  snprintf(audio_message.voice, sizeof(audio_message.voice), "%s", event_voice(events[i]));
+  queue_audio_message(audio_message);
+}
+
+
+// handles every occurrence in (scheduler_watermark, now]. usually that is nothing or one occurrence a few seconds old,
+// but after a boot (see catch_up_from()), a slow loop(), or the clock stepping forward an event may have several.
+// only the latest occurrence of each event is notified, so what happens does not depend on how often this is called.
+void check_for_recent_events(uint16_t interval) {
+  static uint32_t pm = millis();
+  if ((millis() - pm) >= interval) {
+    pm = millis();
+    time_t now = 0;
+    scheduler_clock(&now);
+    bool handled = false;
+    while (!schedule.empty() && events[schedule.front()].next_fire <= now) {
+      uint16_t i = schedule.front();
+      schedule_remove(i);
+      handled = true;
+
+      time_t due = events[i].next_fire;
+      if (now - due > MISSED_EVENTS_MAX_AGE) {
+        due = next_fire_after(events[i].rule, now - MISSED_EVENTS_MAX_AGE);
+      }
+      // next_fire_after() also gives the occurrence after the latest one, which becomes next_fire
+      time_t next = due;
+      while (next != 0 && next <= now) {
+        due = next;
+        next = next_fire_after(events[i].rule, due);
+      }
+
+      if (due != 0 && due <= now) {
+        time_t dt = due - now; // seconds
+        const time_t happening_now_cutoff = (-6*EVENT_CHECK_INTERVAL)/1000; //30 seconds for 5000 millisecond check interval
+        if (happening_now_cutoff <= dt) {
+          // excluded weekdays never make it into next_fire, so everything that is due fires
+          notify(i, due, false);
+        }
+        else {
+          DEBUG_PRINTF("event %u missed by %ld seconds\n", (unsigned)events[i].id, (long)-dt);
+#if MISSED_EVENTS_POLICY == MISSED_EVENTS_SHOW
+          events[i].timestamp = due;
+          notices_version++;
+#elif MISSED_EVENTS_POLICY == MISSED_EVENTS_NOTIFY
+          notify(i, due, true);
+#endif
+        }
+      }
+
+      events[i].next_fire = next;
+      if (events[i].next_fire > now) {
+        schedule_push(i);
+      }
+    }
+    scheduler_watermark = now;
+    if (handled) {
+      schedule_version++; // events that no longer occur were popped without being pushed back
+      save_scheduler_watermark();
+    }
+  }
+}
+
+
+// one source of occurrences in upcoming_occurrences(). node is its position in the schedule, or -1 for a later occurrence of the same event.
+struct UpcomingSource {
+  time_t at;
+  uint16_t index;
+  int32_t node;
+};
+
+
+// fills out with the next n occurrences of all events in time order and returns how many there are.
+// the schedule is already a heap of every event's next occurrence, so it is merged with each event's later occurrences
+// by walking down the heap: a node's children can only come after it, so they are only looked at once the node has been listed.
+// that keeps the work to about n*log(n) whatever the number of events, and nothing is copied from the events table.
+uint16_t upcoming_occurrences(Occurrence* out, uint16_t n) {
+  std::vector<UpcomingSource> sources;
+  if (n == 0 || schedule.empty()) {
+    return 0;
+  }
+  sources.reserve(2*n + 1);
+  // std::push_heap() builds a max-heap, so the comparison is reversed to keep the soonest source on top
+  auto later = [](const UpcomingSource& a, const UpcomingSource& b) { return a.at > b.at; };
+
+  sources.push_back({events[schedule[0]].next_fire, schedule[0], 0});
+  uint16_t count = 0;
+  while (count < n && !sources.empty()) {
+    std::pop_heap(sources.begin(), sources.end(), later);
+    UpcomingSource source = sources.back();
+    sources.pop_back();
+
+    if (source.node >= 0) {
+      for (uint32_t child = 2*source.node + 1; child <= 2*(uint32_t)source.node + 2 && child < schedule.size(); child++) {
+        sources.push_back({events[schedule[child]].next_fire, schedule[child], (int32_t)child});
+        std::push_heap(sources.begin(), sources.end(), later);
+      }
+    }
+
+    const Event& event = events[source.index];
+    // next_fire_after() already stops at the end date. this only catches a next_fire set some other way.
+    if (is_expired(source.at, event.rule)) {
+      continue;
+    }
+    out[count++] = {source.at, event.id};
+
+    time_t next = next_fire_after(event.rule, source.at);
+    if (next != 0) {
+      sources.push_back({next, source.index, -1});
+      std::push_heap(sources.begin(), sources.end(), later);
+    }
+  }
+  return count;
+}
+
+
+// called from loop(). upcoming_occurrences() runs outside the lock, only the copy into upcoming_list is done under it.
+void refresh_upcoming(void) {
+  if (upcoming_version == schedule_version) {
+    return;
+  }
+  upcoming_version = schedule_version;
+  uint16_t count = upcoming_occurrences(upcoming_building, UPCOMING_MAX);
+  xSemaphoreTake(upcoming_lock, portMAX_DELAY);
+  memcpy(upcoming_list, upcoming_building, count*sizeof(Occurrence));
+  upcoming_count = count;
+  xSemaphoreGive(upcoming_lock);
+}
+
+
+// called from the web server. copies the first n of the occurrences refresh_upcoming() last listed to out and returns how many there are.
+uint16_t copy_upcoming(Occurrence* out, uint16_t n) {
+  xSemaphoreTake(upcoming_lock, portMAX_DELAY);
+  uint16_t count = std::min(n, upcoming_count);
+  memcpy(out, upcoming_list, count*sizeof(Occurrence));
+  xSemaphoreGive(upcoming_lock);
+  return count;
+}
+
+
+void clear_event_strings(void) {
+  event_strings.assign(1, '\0');
+  interned_strings.assign(1, 0);
+}
+
+
+// appends s to the arena, cut to size - 1 characters the same way the old fixed size arrays cut it. returns its offset.
+uint32_t add_event_string(const char* s, size_t size, EventTable& table) {
+  size_t len = strnlen(s, size - 1);
+  if (len == 0) {
+    return 0;
+  }
+  uint32_t offset = table.strings.size();
+  table.strings.insert(table.strings.end(), s, s + len);
+  table.strings.push_back('\0');
+  return offset;
+}
+
+
+// returns the index in interned_strings of s, adding it to the arena the first time it is seen.
+// there are only a handful of different sounds and voices, so a linear search is fine.
+uint16_t intern_event_string(const char* s, size_t size, EventTable& table) {
+  size_t len = strnlen(s, size - 1);
+  for (uint16_t i = 0; i < table.interned.size(); i++) {
+    const char* interned = &table.strings[table.interned[i]];
+    if (strncmp(interned, s, len) == 0 && interned[len] == '\0') {
+      return i;
+    }
+  }
+  table.interned.push_back(add_event_string(s, size, table));
+  return table.interned.size() - 1;
+}
+
+
+// the pointers are only good until the next string is added to the arena
+const char* event_description(const Event& event, const EventTable& table) {
+  return &table.strings[event.description];
+}
+
+
+const char* event_sound(const Event& event, const EventTable& table) {
+  return &table.strings[table.interned[event.sound]];
+}
+
+
+const char* event_voice(const Event& event, const EventTable& table) {
+  return &table.strings[table.interned[event.voice]];
+}
@@ -0,0 +1,918 @@
+// events.json specification
+// d == description (max 100 chars), f == frequency, sd == start date, st == start time, ed == end date, et == end time, e == exclude, p == pattern, c == color, s == sound, v == voice
+// frequency: o == Once, d == Daily, w == weekly, m == Monthly, y == Yearly
+//
+// optional recurrence fields (the frequency by itself is shorthand for an interval of 1 on the start date's day):
+// i == interval: repeat every i days, weeks, months, or years. e.g. "f":"d","i":3 is every 3 days
+// bd == by day: weekdays the event occurs on using the same bits as exclude. for weekly events it defaults to the weekday of the start date.
+//       e.g. "f":"w","bd":42 is every Monday, Wednesday, and Friday
+// n == nth weekday for monthly and yearly events. 1 to 5 is the 1st to 5th bd weekday of the month, -1 is the last bd weekday of the month.
+//      e.g. "f":"m","n":2,"bd":4 is the 2nd Tuesday of each month, "f":"y","n":4,"bd":16,"sd":[2024,11,28] is the 4th Thursday of November
+// exclude: is an 8 bit number that stores the sum of the days of the week you wish to skip
+//          1 for Sunday, 2 for Monday, 4 for Tuesday, 8 for Wednesday, 16 for Thursday, 32 for Friday, 64 for Saturday
+//          for example, if you wish to exclude Saturday and Sunday, then set exclude to 1 + 64 => e:65
+// id == stable id of the event, used by the /event endpoints to change or delete one event. unique within the file.
+//       events without an id (files saved before ids were added) use their position in the events array.
+//
+//{"events":[
+//           {"id":0,"d":"Feed+Fish%2C+Morning","f":"d","sd":[2024,9,25],"st":[8,0,0],"ed":null,"et":null,"e":65,"p":2,"c":"0x00FF0000","s":"chime.mp3","v":"en-ca&v=Clara"},
+//           {"id":1,"d":"Feed+Fish%2C+Afternoon","f":"d","sd":[2024,9,25],"st":[16,0,0],"ed":null,"et":null,"e":65,"p":0,"c":"0x000000FF","s":"chime.mp3","v":"en-ca&v=Clara"}
+//          ]
+//}
+//
+// descriptions are percent encoded by the frontend and stored in this format so they can be easily passed to the TTS API.
+// the backend trusts that the frontend gives it valid, preformatted data.
+// generally, not the best idea, but this is just a personal project and not implement formatting like percent encoding in the backend simplifies the code.
+
+
+#include "storage.h"
+
+#include <FS.h>
+#include <LittleFS.h>
+
+#include "ArduinoJson-v6.h"
+#include <StreamUtils.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "renderer.h"
+#include "scheduler.h"
+
+const char* stored_file_list = FILE_ROOT "/file_list.json";
+//const char* sound_URLs = FILE_USR "/sound_URLs.json";
+
+bool events_reload_needed = false;
+
+QueueHandle_t qevent_changes = xQueueCreate(EVENT_CHANGES_QUEUE_LENGTH, sizeof(char*));
+QueueHandle_t qevent_reloads = xQueueCreate(1, sizeof(struct EventsReload));
+QueueHandle_t qevent_tables = xQueueCreate(1, sizeof(struct EventsReload));
+static bool events_reload_running = false; // only used by loop()
+// the journal size apply_event_changes() starts compacting at. raised after a compaction fails so it is not retried on every change.
+static size_t compact_at_size = EVENTS_JOURNAL_MAX_SIZE; // only used by loop()
+static size_t compact_started_size = 0; // only used by loop()
+// bumped by save_file() before it writes events.json. a table built while it changed is not saved as a snapshot.
+static std::atomic<uint32_t> events_json_saves(0);
+
+
+void set_random_sound(char* sound, size_t sound_len) {
+  if (sound == NULL || sound_len == 0) return;
+
+  File file = LittleFS.open(stored_file_list, "r");
+
+  if (!file && !file.available()) {
+    return;
+  }
+
+  DynamicJsonDocument doc(24576);
+  ReadBufferingStream bufferedFile(file, 64);
+  DeserializationError error = deserializeJson(doc, bufferedFile);
+  file.close();
+
+  if (error) {
+    DEBUG_PRINT("deserializeJson() failed: ");
+    DEBUG_PRINTLN(error.c_str());
+    restart_needed = true;
+    return;
+  }
+
+  JsonObject object = doc.as<JsonObject>();
+  JsonArray jsnd = doc[F("/files")][F("snd")].as<JsonArray>();
+
+  if (jsnd.isNull() || jsnd.size() == 0) {
+    return;
+  }
+  uint32_t index = random(jsnd.size());
+  snprintf(sound, sound_len, "%s", jsnd[index].as<const char*>());
+}
+
+
+// the sounds and voices were interned when the snapshot was saved, so equal strings have equal offsets in the blob
+static uint16_t intern_blob_offset(uint32_t offset, EventTable& table) {
+  std::vector<uint32_t>::iterator it = std::find(table.interned.begin(), table.interned.end(), offset);
+  if (it != table.interned.end()) {
+    return it - table.interned.begin();
+  }
+  table.interned.push_back(offset);
+  return table.interned.size() - 1;
+}
+
+
+// CRC-32 (the same as zlib's) a nibble at a time, so the table is 16 entries instead of 256.
+static uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len) {
+  static const uint32_t nibble_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = (crc >> 4) ^ nibble_table[(crc ^ data[i]) & 0x0F];
+    crc = (crc >> 4) ^ nibble_table[(crc ^ (data[i] >> 4)) & 0x0F];
+  }
+  return ~crc;
+}
+
+
+// the size alone misses a save that keeps events.json the same size, so the snapshot is matched to the file's contents.
+// returns false if events.json could not be read.
+bool events_json_crc(uint32_t* crc) {
+  File file = LittleFS.open(USR_ROOT "/events.json", "r");
+  if (!file) {
+    return false;
+  }
+  uint8_t buffer[256];
+  *crc = 0;
+  size_t bytes_read;
+  while ((bytes_read = file.read(buffer, sizeof(buffer))) > 0) {
+    *crc = crc32_update(*crc, buffer, bytes_read);
+  }
+  file.close();
+  return true;
+}
+
+
+// returns true if table was loaded from the snapshot.
+// false means there is no snapshot or it was not made from the events.json with json_crc, so events.json has to be parsed instead.
+bool load_events_snapshot(EventTable& table, time_t after, uint32_t json_crc) {
+  File file = LittleFS.open(EVENTS_SNAPSHOT_PATH, "r");
+  if (!file) {
+    return false;
+  }
+
+  // the whole snapshot is read with one call then the events are built directly from the records
+  size_t size = file.size();
+  uint8_t* buffer = (uint8_t*)malloc(size);
+  if (buffer == NULL) {
+    file.close();
+    return false;
+  }
+  size_t bytes_read = file.read(buffer, size);
+  file.close();
+
+  const struct EventsSnapshotHeader* header = (const struct EventsSnapshotHeader*)buffer;
+  bool valid = bytes_read == size && size >= sizeof(struct EventsSnapshotHeader)
+               && header->magic == EVENTS_SNAPSHOT_MAGIC && header->version == EVENTS_SNAPSHOT_VERSION
+               && header->record_size == sizeof(struct EventRecord) && header->json_crc == json_crc
+               && header->blob_size > 0 && size == sizeof(struct EventsSnapshotHeader) + header->num_records*sizeof(struct EventRecord) + header->blob_size
+               && buffer[size - header->blob_size] == '\0' && buffer[size-1] == '\0';
+  if (!valid) {
+    DEBUG_PRINTLN("events snapshot is invalid or out of date");
+    free(buffer);
+    return false;
+  }
+
+  const struct EventRecord* records = (const struct EventRecord*)(buffer + sizeof(struct EventsSnapshotHeader));
+  const char* blob = (const char*)(records + header->num_records);
+  table.strings.assign(blob, blob + header->blob_size);
+  if (header->next_id > 0) {
+    reserve_id(header->next_id - 1, table); // covers the expired events that are in events.json but not in the snapshot
+  }
+  table.events.reserve(header->num_records);
+  for (uint32_t i = 0; i < header->num_records; i++) {
+    const struct EventRecord& record = records[i];
+    if (record.description >= header->blob_size || record.sound >= header->blob_size || record.voice >= header->blob_size) {
+      continue;
+    }
+
+    struct Event event;
+    event.rule = record.rule;
+    event.next_fire = next_fire_after(event.rule, after);
+    if (is_expired(event.next_fire, event.rule)) {
+      continue;
+    }
+
+    event.id = record.id;
+    event.description = record.description;
+    event.pattern = record.pattern;
+    event.priority = std::min<uint8_t>(record.priority, PRIORITY_MAX);
+    event.color = record.color;
+    event.is_random_sound = record.is_random_sound;
+    event.sound = intern_blob_offset(record.sound, table);
+    event.voice = intern_blob_offset(record.voice, table);
+    event.timestamp = 0;
+    table.events.push_back(event);
+  }
+  free(buffer);
+
+  DEBUG_PRINT("events loaded from snapshot: ");
+  DEBUG_PRINTLN(table.events.size());
+  return true;
+}
+
+
+// called after events.json has been parsed or rewritten by compact_events_file(), so the snapshot holds the same events as table.
+bool save_events_snapshot(uint32_t json_crc, const EventTable& table) {
+  File file = LittleFS.open(EVENTS_SNAPSHOT_PATH, "w");
+  if (!file) {
+    DEBUG_PRINTLN("save_events_snapshot(): Could not open file.");
+    return false;
+  }
+
+  struct EventsSnapshotHeader header = {EVENTS_SNAPSHOT_MAGIC, EVENTS_SNAPSHOT_VERSION, sizeof(struct EventRecord), json_crc, (uint32_t)table.events.size(), (uint32_t)table.strings.size(), table.next_id};
+  bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+
+  for (const Event& event : table.events) {
+    struct EventRecord record;
+    memset(&record, 0, sizeof(record)); // so the padding bytes are written as zeros
+    record.rule = event.rule;
+    record.id = event.id;
+    record.pattern = event.pattern;
+    record.is_random_sound = event.is_random_sound;
+    record.priority = event.priority;
+    record.color = event.color;
+    record.description = event.description;
+    record.sound = table.interned[event.sound];
+    record.voice = table.interned[event.voice];
+    ok = ok && file.write((const uint8_t*)&record, sizeof(record)) == sizeof(record);
+  }
+
+  ok = ok && file.write((const uint8_t*)table.strings.data(), table.strings.size()) == table.strings.size();
+  file.close();
+
+  if (!ok) {
+    DEBUG_PRINTLN("save_events_snapshot(): Could not write file.");
+    LittleFS.remove(EVENTS_SNAPSHOT_PATH);
+  }
+  return ok;
+}
+
+
+// builds an event from one object of the events array or one line of the journal. everything but the id is filled in.
+// the event is scheduled from its first occurrence after the given time and its strings are added to table.
+// returns false if the event has no start date and time or it will never occur again.
+static bool event_from_json(JsonObject jevent, struct Event& event, time_t after, EventTable& table) {
+  JsonArray start_date = jevent[F("sd")];
+  JsonArray event_time = jevent[F("st")];
+  if (start_date.isNull() || start_date.size() != 3 || event_time.isNull() || (event_time.size() != 2 && event_time.size() != 3)) {
+    return false;
+  }
+
+  // entire year is stored in json file to make it more human readable.
+  // json file represents January with 1 to make it more human readable.
+  event.rule.start_day = days_from_civil(start_date[0].as<uint16_t>(), start_date[1].as<uint8_t>(), start_date[2].as<uint8_t>());
+  event.rule.time_of_day = event_time[0].as<uint8_t>()*3600 + event_time[1].as<uint8_t>()*60;
+  if (event_time.size() == 3) {
+    // html time element on mobile may not allow setting seconds
+    event.rule.time_of_day += event_time[2].as<uint8_t>();
+  }
+
+  event.rule.frequency = 'o';
+  if (!jevent[F("f")].isNull()) {
+    event.rule.frequency = jevent[F("f")].as<const char*>()[0];
+  }
+
+  event.rule.interval = 1;
+  if (!jevent[F("i")].isNull() && jevent[F("i")].as<uint16_t>() > 0) {
+    event.rule.interval = jevent[F("i")].as<uint16_t>();
+  }
+
+  event.rule.nth = 0;
+  if (!jevent[F("n")].isNull()) {
+    event.rule.nth = jevent[F("n")].as<int8_t>();
+  }
+
+  // weekly events and nth weekday events use the weekday of the start date when bd is not set
+  event.rule.by_day = 1 << weekday_from_days(event.rule.start_day);
+  if (!jevent[F("bd")].isNull() && (jevent[F("bd")].as<uint8_t>() & 0x7F) != 0) {
+    event.rule.by_day = jevent[F("bd")].as<uint8_t>() & 0x7F;
+  }
+
+  event.rule.exclude = 0;
+  if (!jevent[F("e")].isNull()) {
+    event.rule.exclude = jevent[F("e")].as<uint8_t>() & 0x7F;
+    DEBUG_PRINT("exclude: ");
+    DEBUG_PRINTLN(event.rule.exclude);
+  }
+
+  int8_t num_occurences = 0;
+  if (!jevent[F("o")].isNull()) {
+    num_occurences = jevent[F("o")].as<int8_t>();
+  }
+
+  const char* description = "";
+  if (!jevent[F("d")].isNull()) {
+    description = jevent[F("d")];
+  }
+  // this is the description from the frontend. if it is too long it will be shortened when stored in event.description
+  DEBUG_PRINT("\ndescription: ");
+  DEBUG_PRINTLN(description);
+
+  // an event without an end date never ends, even if it has an end time
+  event.rule.end_day = NO_OCCURRENCE;
+  event.rule.end_time_of_day = 0;
+  JsonArray end_date = jevent[F("ed")];
+  if (!end_date.isNull() && end_date.size() == 3) {
+    event.rule.end_day = days_from_civil(end_date[0].as<uint16_t>(), end_date[1].as<uint8_t>(), end_date[2].as<uint8_t>());
+  }
+  JsonArray end_time = jevent[F("et")];
+  if (!end_time.isNull() && (end_time.size() == 2 || end_time.size() == 3)) {
+    event.rule.end_time_of_day = end_time[0].as<uint8_t>()*3600 + end_time[1].as<uint8_t>()*60;
+    if (end_time.size() == 3) {
+      // html time element on mobile may not allow setting seconds
+      event.rule.end_time_of_day += end_time[2].as<uint8_t>();
+    }
+  }
+
+  event.next_fire = next_fire_after(event.rule, after);
+
+#if defined DEBUG_CONSOLE
+  struct tm datetime;
+  localtime_r(&event.next_fire, &datetime);
+  char buffer[100];
+  strftime(buffer, sizeof(buffer), "%a %Y/%m/%d %H:%M:%S %Z (%z)", &datetime);
+  DEBUG_PRINTF("refreshed datetime: %s\n", buffer);
+#endif
+
+  if (is_expired(event.next_fire, event.rule)) {
+    return false;
+  }
+
+  uint8_t pattern = 0;
+  if (!jevent[F("p")].isNull()) {
+    pattern = jevent[F("p")].as<uint8_t>();
+  }
+
+  uint32_t color = 0x00FF0000;
+  if (!jevent[F("c")].isNull()) {
+    const char* cs = jevent[F("c")];
+    if (strlen(cs) == 10) {
+      color = strtoul(cs, NULL, 16);
+    }
+  }
+
+  const char* sound = "";
+  if (!jevent[F("s")].isNull()) {
+    sound = jevent[F("s")];
+  }
+
+  //for random sounds we wish the sound to be randomized every time the event occurrs, but
+  //also want the same sound to be replayed by single_click_handler()
+  //therefore when sound is "?????" we do not replace it directly with a random sound because
+  //the same random sound would be reused every time the event occurred.
+  //
+  //events json file does not actually have a field that directly correlates to is_random_sound
+  //when the file is loaded by this function, sound is used to set is_random_sound
+  //then when the event occurs is_random_sound is used to indicate that event.sound would be
+  //replaced with a random sound.
+  boolean is_random_sound = false;
+  if (strncmp(sound, RANDOM_SOUND_MARKER, strlen(RANDOM_SOUND_MARKER)*sizeof(char)) == 0) {
+    is_random_sound = true;
+  }
+
+  const char* voice = "";
+  if (!jevent[F("v")].isNull()) {
+    voice = jevent[F("v")];
+  }
+
+  uint8_t priority = 0;
+  if (!jevent[F("r")].isNull()) {
+    priority = std::min<uint8_t>(jevent[F("r")].as<uint8_t>(), PRIORITY_MAX);
+  }
+
+  event.description = add_event_string(description, DESCRIPTION_SIZE, table);
+  event.pattern = pattern;
+  event.priority = priority;
+  event.color = color;
+  event.is_random_sound = is_random_sound;
+  event.sound = intern_event_string(sound, SOUND_SIZE, table);
+  event.voice = intern_event_string(voice, VOICE_SIZE, table);
+  event.timestamp = 0;
+
+#if defined DEBUG_CONSOLE
+  // all of this is for outputting debugging info and is not required
+  struct tm local_now = {0};
+  time_t now;
+  scheduler_clock(&now);
+  localtime_r(&now, &local_now);
+  time_t tnow = mktime(&local_now);
+  DEBUG_PRINT("seconds remaining: ");
+  DEBUG_PRINTLN(difftime(event.next_fire, tnow));
+
+  strftime(buffer, sizeof(buffer), "%a %Y/%m/%d %H:%M:%S %Z (%z)", &datetime);
+  DEBUG_PRINTF("event put on schedule: %s\n", buffer);
+  //strftime(buffer, sizeof(buffer), "%a %Y/%m/%d %H:%M:%S %Z (%z)", &local_now);
+  //DEBUG_PRINTF("local_now: %s\n\n", buffer);
+#endif
+
+  return true;
+}
+
+
+// the keys an Event is built from, so unknown keys from the frontend cannot overflow the document an event is parsed into
+static const char* event_keys[] = {"id", "x", "d", "f", "i", "bd", "n", "o", "sd", "st", "ed", "et", "e", "p", "c", "s", "v", "r"};
+typedef StaticJsonDocument<JSON_OBJECT_SIZE(sizeof(event_keys)/sizeof(event_keys[0]))> EventFilter;
+
+static void fill_event_filter(EventFilter& filter) {
+  for (const char* key : event_keys) {
+    filter[key] = true;
+  }
+}
+
+
+// returns true if events.json could not be read.
+static bool parse_events_json(EventTable& table, time_t after) {
+  File file = LittleFS.open(USR_ROOT "/events.json", "r");
+  
+  if (!file && !file.available()) {
+    return true;
+  }
+
+  // the events array is read one event at a time so memory use does not depend on the number of events.
+  ReadBufferingStream bufferedFile(file, 64);
+  if (!bufferedFile.find("\"events\"") || !bufferedFile.find("[")) {
+    file.close();
+    return true;
+  }
+
+  EventFilter filter;
+  fill_event_filter(filter);
+  // one event with a 300 character description, 100 character sound, and all of the date and time arrays
+  StaticJsonDocument<EVENT_JSON_SIZE> doc;
+
+  bool failed = false;
+  uint16_t index = 0;
+  do {
+    while (isspace(bufferedFile.peek())) {
+      bufferedFile.read();
+    }
+    if (bufferedFile.peek() == ']') {
+      break; // empty array
+    }
+
+    DeserializationError error = deserializeJson(doc, bufferedFile, DeserializationOption::Filter(filter));
+    if (error) {
+      DEBUG_PRINT("deserializeJson() failed: ");
+      DEBUG_PRINTLN(error.c_str());
+      restart_needed = true;
+      failed = true;
+      break;
+    }
+
+    JsonObject jevent = doc.as<JsonObject>();
+    // files saved before events had ids use the position in the array instead
+    uint16_t id = jevent[F("id")].isNull() ? index : jevent[F("id")].as<uint16_t>();
+    index++;
+    // expired events keep their id, so it is not handed out again
+    reserve_id(id, table);
+
+    struct Event event;
+    if (event_from_json(jevent, event, after, table)) {
+      event.id = id;
+      DEBUG_PRINT("event.id: ");
+      DEBUG_PRINTLN(event.id);
+      table.events.push_back(event);
+    }
+  } while (bufferedFile.findUntil(",", "]"));
+  file.close();
+
+  return failed;
+}
+
+
+// one line of the journal. a line with "x" deletes the event, anything else replaces it or adds it if the id is new.
+static void apply_event_change(JsonObject jchange, time_t after, EventTable& table) {
+  if (jchange[F("id")].isNull()) {
+    return;
+  }
+  uint16_t id = jchange[F("id")].as<uint16_t>();
+  reserve_id(id, table);
+
+  struct Event event;
+  if (!jchange[F("x")].isNull() || !event_from_json(jchange, event, after, table)) {
+    // deleted, or changed so it never occurs again
+    remove_event(id, table);
+    return;
+  }
+  event.id = id;
+  put_event(event, table);
+}
+
+
+// replays the journal on top of the events loaded from events.json or the snapshot.
+static void load_events_journal(EventTable& table, time_t after) {
+  File file = LittleFS.open(EVENTS_JOURNAL_PATH, "r");
+  if (!file) {
+    return;
+  }
+
+  EventFilter filter;
+  fill_event_filter(filter);
+  StaticJsonDocument<EVENT_JSON_SIZE> doc;
+  ReadBufferingStream bufferedFile(file, 64);
+  while (bufferedFile.available() > 0) {
+    String line = bufferedFile.readStringUntil('\n');
+    if (line.length() == 0) {
+      continue;
+    }
+    DeserializationError error = deserializeJson(doc, line.c_str(), DeserializationOption::Filter(filter));
+    if (error) {
+      // a bad line only loses that one change
+      DEBUG_PRINT("events journal deserializeJson() failed: ");
+      DEBUG_PRINTLN(error.c_str());
+      continue;
+    }
+    apply_event_change(doc.as<JsonObject>(), after, table);
+  }
+  file.close();
+}
+
+
+// fills an empty table from the events files. only reads the files and table, so it can run on events_loader()'s task.
+// returns true if events.json could not be read.
+static bool build_event_table(EventTable& table, time_t after) {
+  bool failed = false;
+  uint32_t saves = events_json_saves;
+  uint32_t json_crc = 0;
+  if (!events_json_crc(&json_crc) || !load_events_snapshot(table, after, json_crc)) {
+    failed = parse_events_json(table, after);
+    // if /save wrote events.json in the meantime the table may not be what json_crc was taken from.
+    // /save also asked for another reload, which makes the snapshot then.
+    if (!failed && events_json_saves == saves) {
+      save_events_snapshot(json_crc, table);
+    }
+  }
+  // the journal is applied with put_event() and remove_event(), which need the schedule and its indices
+  schedule_rebuild(table);
+  if (!failed) {
+    load_events_journal(table, after);
+  }
+  table.strings.shrink_to_fit();
+  return failed;
+}
+
+
+// loads the events files and swaps them in right away. used at boot and by [env:native], loop() uses start_events_reload().
+// the events table is replaced even if events.json is unavailable or invalid.
+bool load_events_file() {
+  // occurrences since the scheduler's watermark are loaded as already due, so the ones missed during a restart are not lost
+  EventTable table;
+  bool failed = build_event_table(table, catch_up_from());
+  swap_event_table(table);
+  return failed;
+}
+
+
+// task that builds the events table for start_events_reload() while loop() keeps rendering with the old one.
+void events_loader(void* parameter) {
+  struct EventsReload reload;
+  while (true) {
+    if (xQueueReceive(qevent_reloads, &reload, portMAX_DELAY) == pdTRUE) {
+      if (reload.compact) {
+        reload.compact_failed = !compact_events_file();
+      }
+      // the files did not change when compacting failed, so the table in use is still right
+      if (!reload.compact_failed) {
+        reload.failed = build_event_table(*reload.table, reload.after);
+      }
+      xQueueSend(qevent_tables, &reload, portMAX_DELAY);
+      wake_loop();
+    }
+  }
+}
+
+
+// returns false if a reload is already running. event changes stay queued until it is done, so the journal does not change under it.
+// with compact the journal is folded into events.json first, the table built afterwards is the same events with their strings repacked.
+bool start_events_reload(bool compact) {
+  if (events_reload_running) {
+    return false;
+  }
+  struct EventsReload reload = {new EventTable, catch_up_from(), compact, false, false};
+  if (xQueueSend(qevent_reloads, &reload, 0) != pdTRUE) {
+    delete reload.table;
+    return false;
+  }
+  events_reload_running = true;
+  return true;
+}
+
+
+// swaps in the table built by events_loader() if it is done. returns true when the reload is done, the table is not replaced if compacting failed.
+// the old table is freed here rather than on the loader's task, it is only a few frees.
+bool finish_events_reload(void) {
+  struct EventsReload reload;
+  if (!events_reload_running || xQueueReceive(qevent_tables, &reload, 0) != pdTRUE) {
+    return false;
+  }
+  if (!reload.compact_failed) {
+    swap_event_table(*reload.table);
+  }
+  delete reload.table;
+  events_reload_running = false;
+  if (reload.compact_failed) {
+    // only tried again once as much again has been written to the journal, or after events.json is saved and reloaded
+    compact_at_size = compact_started_size + EVENTS_JOURNAL_MAX_SIZE;
+  }
+  else if (!reload.failed) {
+    compact_at_size = EVENTS_JOURNAL_MAX_SIZE;
+  }
+  if (reload.failed) {
+    events_reload_needed = true; // try again, the same as when load_events_file() failed
+  }
+  return true;
+}
+
+
+// called from the web server. the change is checked and queued here, then written and applied by apply_event_changes() in loop()
+// so the events table and the events files are only ever changed by loop(). json is the event object, or empty to delete the event.
+// id is NEW_EVENT_ID to add an event. it is set to the new event's id once the change is known to be good, so a rejected one uses up no id.
+bool queue_event_change(uint16_t* id, const String& json, String& message) {
+  // only the web server sends to qevent_changes, so there is still room after the checks below
+  if (uxQueueMessagesWaiting(qevent_changes) >= EVENT_CHANGES_QUEUE_LENGTH) {
+    message = F("Too many changes waiting to be saved.");
+    return false;
+  }
+
+  DynamicJsonDocument doc(EVENT_JSON_SIZE);
+  if (json != "") {
+    DeserializationError error = deserializeJson(doc, json.c_str());
+    if (error || !doc.is<JsonObject>()) {
+      message = F("Event is not a valid JSON object.");
+      return false;
+    }
+    doc.remove("x");
+  }
+  else {
+    doc["x"] = 1;
+  }
+  doc["id"] = *id; // NEW_EVENT_ID is the longest id, so len is enough for whatever id is handed out
+  if (doc.overflowed()) {
+    message = F("Event is too large.");
+    return false;
+  }
+
+  size_t len = measureJson(doc);
+  char* change = (char*)malloc(len + 1);
+  if (change == NULL) {
+    message = F("Out of memory.");
+    return false;
+  }
+  if (*id == NEW_EVENT_ID) {
+    *id = new_id(false);
+    doc["id"] = *id;
+  }
+  serializeJson(doc, change, len + 1);
+  if (xQueueSend(qevent_changes, &change, 0) != pdTRUE) {
+    free(change);
+    message = F("Too many changes waiting to be saved.");
+    return false;
+  }
+  set_event_id_known(*id, json != "");
+  message = F("Event change queued.");
+  wake_loop();
+  return true;
+}
+
+
+// appends the queued changes to the journal and applies them to the events table.
+// only the changed events are parsed and rescheduled, the rest of the table is left alone.
+void apply_event_changes(void) {
+  if (events_reload_running || uxQueueMessagesWaiting(qevent_changes) == 0) {
+    return;
+  }
+
+  EventFilter filter;
+  fill_event_filter(filter);
+  StaticJsonDocument<EVENT_JSON_SIZE> doc;
+  time_t now;
+  scheduler_clock(&now);
+
+  // LittleFS only commits what was written when the file is closed, so a power loss cannot leave half a line behind
+  File file = LittleFS.open(EVENTS_JOURNAL_PATH, "a");
+  char* change;
+  while (xQueueReceive(qevent_changes, &change, 0) == pdTRUE) {
+    if (!file || file.print(change) != strlen(change) || file.print('\n') != 1) {
+      DEBUG_PRINTLN("apply_event_changes(): Could not write journal.");
+    }
+    else if (!deserializeJson(doc, (const char*)change, DeserializationOption::Filter(filter))) {
+      JsonObject jchange = doc.as<JsonObject>();
+      apply_event_change(jchange, now, event_table);
+      set_event_id_known(jchange[F("id")].as<uint16_t>(), jchange[F("x")].isNull());
+    }
+    free(change);
+  }
+  size_t journal_size = file.size();
+  file.close();
+
+  // rewriting events.json takes seconds with thousands of events, so it is done on events_loader()'s task
+  if (journal_size > compact_at_size && start_events_reload(true)) {
+    compact_started_size = journal_size;
+  }
+}
+
+
+// reads the next object from the events array exactly as it is in the file, including the keys only the frontend uses,
+// so it can be copied without being parsed and serialized again whatever its size. returns false at the end of the array or on bad JSON.
+static bool read_raw_event(Stream& in, String& out) {
+  out = "";
+  if (in.peek() != '{') {
+    return false;
+  }
+  uint16_t depth = 0;
+  bool in_string = false;
+  bool escaped = false;
+  int c;
+  while ((c = in.read()) >= 0) {
+    out += (char)c;
+    if (in_string) {
+      if (escaped) {
+        escaped = false;
+      }
+      else if (c == '\\') {
+        escaped = true;
+      }
+      else if (c == '"') {
+        in_string = false;
+      }
+    }
+    else if (c == '"') {
+      in_string = true;
+    }
+    else if (c == '{' || c == '[') {
+      depth++;
+    }
+    else if ((c == '}' || c == ']') && --depth == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+// folds the journal back into events.json so the journal does not grow forever.
+// events.json is copied one event at a time to a temporary file with the changed events replaced, then the copy replaces events.json.
+// this is the only time an event change costs more than a line in the journal, and it happens once every EVENTS_JOURNAL_MAX_SIZE bytes of changes.
+// only "id" and "x" are parsed, the events that did not change are copied as they are.
+// runs on events_loader()'s task, which builds the table from the new events.json afterwards.
+bool compact_events_file(void) {
+  uint32_t saves = events_json_saves;
+  // the last change made to each id
+  std::vector<uint16_t> ids;
+  std::vector<String> changes; // empty when the event was deleted
+  StaticJsonDocument<JSON_OBJECT_SIZE(2)> id_filter;
+  id_filter["id"] = true;
+  id_filter["x"] = true;
+  StaticJsonDocument<JSON_OBJECT_SIZE(2) + 8> doc; // the keys are copied, "id" and "x" need 5 bytes
+
+  File journal = LittleFS.open(EVENTS_JOURNAL_PATH, "r");
+  if (journal) {
+    ReadBufferingStream bufferedJournal(journal, 64);
+    while (bufferedJournal.available() > 0) {
+      String line = bufferedJournal.readStringUntil('\n');
+      if (line.length() == 0 || deserializeJson(doc, line.c_str(), DeserializationOption::Filter(id_filter)) || doc[F("id")].isNull()) {
+        continue;
+      }
+      uint16_t id = doc[F("id")].as<uint16_t>();
+      if (!doc[F("x")].isNull()) {
+        line = "";
+      }
+      std::vector<uint16_t>::iterator it = std::find(ids.begin(), ids.end(), id);
+      if (it == ids.end()) {
+        ids.push_back(id);
+        changes.push_back(line);
+      }
+      else {
+        changes[it - ids.begin()] = line;
+      }
+    }
+    journal.close();
+  }
+  std::vector<bool> written(ids.size(), false);
+
+  File out = LittleFS.open(USR_ROOT "/events.tmp", "w");
+  if (!out) {
+    DEBUG_PRINTLN("compact_events_file(): Could not open file.");
+    return false;
+  }
+  WriteBufferingStream bufferedOut(out, 64);
+  bufferedOut.print("{\"events\":[");
+
+  bool ok = true;
+  bool first = true;
+  File in = LittleFS.open(USR_ROOT "/events.json", "r");
+  if (in) {
+    ReadBufferingStream bufferedIn(in, 64);
+    if (bufferedIn.find("\"events\"") && bufferedIn.find("[")) {
+      uint16_t index = 0;
+      do {
+        while (isspace(bufferedIn.peek())) {
+          bufferedIn.read();
+        }
+        if (bufferedIn.peek() == ']') {
+          break; // empty array
+        }
+        String raw;
+        if (!read_raw_event(bufferedIn, raw) || deserializeJson(doc, raw.c_str(), DeserializationOption::Filter(id_filter))) {
+          ok = false;
+          break;
+        }
+        bool has_id = !doc[F("id")].isNull();
+        uint16_t id = has_id ? doc[F("id")].as<uint16_t>() : index;
+        index++;
+
+        std::vector<uint16_t>::iterator it = std::find(ids.begin(), ids.end(), id);
+        if (it != ids.end()) {
+          size_t j = it - ids.begin();
+          written[j] = true;
+          if (changes[j].length() > 0) {
+            bufferedOut.print(first ? "" : ",");
+            bufferedOut.print(changes[j]);
+            first = false;
+          }
+        }
+        else {
+          bufferedOut.print(first ? "" : ",");
+          if (has_id) {
+            bufferedOut.print(raw);
+          }
+          else {
+            // every event gets an id written, so files saved before events had ids are converted here
+            bufferedOut.print("{\"id\":");
+            bufferedOut.print(id);
+            const char* rest = raw.c_str() + 1;
+            while (isspace(*rest)) {
+              rest++;
+            }
+            bufferedOut.print((*rest == '}') ? "" : ",");
+            bufferedOut.print(rest);
+          }
+          first = false;
+        }
+      } while (bufferedIn.findUntil(",", "]"));
+    }
+    in.close();
+  }
+
+  // added events go at the end
+  for (size_t j = 0; j < ids.size(); j++) {
+    if (!written[j] && changes[j].length() > 0) {
+      bufferedOut.print(first ? "" : ",");
+      bufferedOut.print(changes[j]);
+      first = false;
+    }
+  }
+  bufferedOut.print("]}");
+  bufferedOut.flush();
+  out.close();
+
+  if (!ok) {
+    DEBUG_PRINTLN("compact_events_file(): Could not read events.json.");
+    LittleFS.remove(USR_ROOT "/events.tmp");
+    return false;
+  }
+
+  if (events_json_saves != saves) {
+    // /save replaced events.json and the journal while this was copying them
+    LittleFS.remove(USR_ROOT "/events.tmp");
+    return true;
+  }
+
+  // rename() replaces events.json in one step, so a power loss leaves either the old file and the journal or the new file
+  if (!LittleFS.rename(USR_ROOT "/events.tmp", USR_ROOT "/events.json")) {
+    DEBUG_PRINTLN("compact_events_file(): Could not replace events.json.");
+    LittleFS.remove(USR_ROOT "/events.tmp");
+    return false;
+  }
+  LittleFS.remove(EVENTS_JOURNAL_PATH);
+  return true;
+}
+
+
+bool save_file(String fs_path, String json, String& message) {
+  if (fs_path == "") {
+    if (message) {
+      message = F("save_file(): Filename is empty. Data not saved.");
+    }
+    return false;
+  }
+
+  //create_dirs(fs_path.substring(0, fs_path.lastIndexOf("/")+1));
+  if (fs_path == USR_ROOT "/events.json") {
+    events_json_saves++; // before writing, so a reload that reads the new file before this returns does not keep a snapshot of it
+  }
+  File f = LittleFS.open(fs_path, "w");
+  if (f) {
+    //noInterrupts();
+    f.print(json);
+    delay(1);
+    f.close();
+    //interrupts();
+    if (fs_path == USR_ROOT "/events.json") {
+      // the snapshot no longer matches. load_events_file() will make a new one.
+      // the whole file replaces every change in the journal.
+      LittleFS.remove(EVENTS_SNAPSHOT_PATH);
+      LittleFS.remove(EVENTS_JOURNAL_PATH);
+    }
+  }
+  else {
+    if (message) {
+      message = F("save_file(): Could not open file.");
+    }
+    return false;
+  }
+
+  if (message) {
+    message = F("save_file(): Data saved.");
+  }
+  return true;
+}
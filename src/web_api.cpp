@@ -0,0 +1,142 @@
+#include "web_api.h"
+
+#include "config.h"
+#include "audio_queue.h"
+#include "renderer.h"
+#include "scheduler.h"
+#include "storage.h"
+
+
+void web_api_setup(AsyncWebServer& server) {
+  server.on("/save", HTTP_POST, [](AsyncWebServerRequest *request) {
+    int rc = 400;
+    String message;
+
+    String id = request->getParam("id", true)->value();
+    String json = request->getParam("json", true)->value();
+
+    if (id != "") {
+      String fs_path = id;
+      if (id == USR_ROOT "/events.json" && save_file(fs_path, json, message)) {
+        events_reload_needed = true;
+        wake_loop();
+        rc = 200;
+      }
+      if (id == USR_ROOT "/sound_URLs.json" && save_file(fs_path, json, message)) {
+        rc = 200;
+      }
+    }
+    else {
+      message = "Invalid type.";
+    }
+
+    request->send(rc, "application/json", "{\"message\": \""+message+"\"}");
+  });
+
+  // add, change, or delete one event by its id. only that event is rescheduled and only a line is appended to the events journal,
+  // the rest of the events table and events.json are left alone. the change is applied by loop() a moment later.
+  server.on("/event/add", HTTP_POST, [](AsyncWebServerRequest *request) {
+    int rc = 400;
+    String message = "Missing json.";
+    uint16_t id = NEW_EVENT_ID;
+
+    if (request->hasParam("json", true) && queue_event_change(&id, request->getParam("json", true)->value(), message)) {
+      rc = 200;
+    }
+
+    request->send(rc, "application/json", "{\"id\": "+((rc == 200) ? String(id) : String("null"))+", \"message\": \""+message+"\"}");
+  });
+
+  server.on("/event/update", HTTP_POST, [](AsyncWebServerRequest *request) {
+    int rc = 400;
+    String message = "Missing id or json.";
+
+    if (request->hasParam("id", true) && request->hasParam("json", true)) {
+      long id = request->getParam("id", true)->value().toInt();
+      uint16_t event_id = id;
+      // a deleted event is not brought back by changing it
+      if (id < 0 || id >= NEW_EVENT_ID || !is_event_id_known(id)) {
+        rc = 404;
+        message = "Unknown event id.";
+      }
+      else if (queue_event_change(&event_id, request->getParam("json", true)->value(), message)) {
+        rc = 200;
+      }
+    }
+
+    request->send(rc, "application/json", "{\"message\": \""+message+"\"}");
+  });
+
+  server.on("/event/delete", HTTP_POST, [](AsyncWebServerRequest *request) {
+    int rc = 400;
+    String message = "Missing id.";
+
+    if (request->hasParam("id", true)) {
+      long id = request->getParam("id", true)->value().toInt();
+      uint16_t event_id = id;
+      if (id < 0 || id >= NEW_EVENT_ID || !is_event_id_known(id)) {
+        rc = 404;
+        message = "Unknown event id.";
+      }
+      else if (queue_event_change(&event_id, "", message)) {
+        rc = 200;
+      }
+    }
+
+    request->send(rc, "application/json", "{\"message\": \""+message+"\"}");
+  });
+
+  // the next n (default 20) occurrences of all events in time order as {"upcoming":[{"id":N,"t":seconds since the Unix Epoch},...]}
+  server.on("/upcoming.json", HTTP_GET, [](AsyncWebServerRequest *request) {
+    uint16_t n = 20;
+    if (request->hasParam("n")) {
+      long requested = request->getParam("n")->value().toInt();
+      n = (requested < 1) ? 1 : (requested > UPCOMING_MAX) ? UPCOMING_MAX : requested;
+    }
+
+    // copied so the lock is not held while the response is written
+    Occurrence* list = new Occurrence[n];
+    uint16_t count = copy_upcoming(list, n);
+
+    // written straight into the response buffer instead of building the JSON in a String first
+    AsyncResponseStream* response = request->beginResponseStream("application/json");
+    response->print("{\"upcoming\":[");
+    for (uint16_t i = 0; i < count; i++) {
+      response->printf("%s{\"id\":%u,\"t\":%lld}", (i > 0) ? "," : "", (unsigned)list[i].id, (long long)list[i].at);
+    }
+    response->print("]}");
+    delete[] list;
+    request->send(response);
+  });
+
+  server.on("/audio_stats.json", HTTP_GET, [](AsyncWebServerRequest *request) {
+    struct AudioQueueStats stats = audio_queue_stats;
+    // messages still in qaudio_messages are waiting too, aural_notifier() just has not moved them into its list yet
+    uint32_t depth = stats.depth + uxQueueMessagesWaiting(qaudio_messages);
+    uint32_t starts = stats.played + stats.preempted;
+    char out_json[256];
+    snprintf(out_json, sizeof(out_json), "{\"queued\":%u,\"played\":%u,\"preempted\":%u,\"dropped\":%u,\"depth\":%u,\"max_depth\":%u,\"wait_ms_mean\":%u,\"wait_ms_max\":%u}",
+             (unsigned)stats.queued, (unsigned)stats.played, (unsigned)stats.preempted, (unsigned)(stats.dropped_sending + stats.dropped_pending), (unsigned)depth,
+             (unsigned)stats.max_depth, (unsigned)(starts ? stats.wait_ms_total/starts : 0), (unsigned)stats.wait_ms_max);
+    request->send(200, "application/json", out_json);
+  });
+
+  server.on("/render_stats.json", HTTP_GET, [](AsyncWebServerRequest *request) {
+    struct RenderStats stats = render_stats;
+    char out_json[320];
+    snprintf(out_json, sizeof(out_json), "{\"fps\":%u,\"frames\":%u,\"skipped\":%u,\"dropped\":%u,\"frame_ms\":%u,\"late_ms_max\":%u,\"output_busy\":%u,"
+             "\"render_us\":%u,\"render_us_max\":%u,\"show_us\":%u,\"show_us_max\":%u,\"ticks_caught_up\":%u,\"ticks_lost\":%u}",
+             (unsigned)RENDER_FPS, (unsigned)stats.frames, (unsigned)stats.skipped, (unsigned)stats.dropped, (unsigned)stats.frame_ms,
+             (unsigned)stats.late_ms_max, (unsigned)stats.output_busy, (unsigned)stats.render_us, (unsigned)stats.render_us_max,
+             (unsigned)stats.show_us, (unsigned)stats.show_us_max, (unsigned)stats.ticks_caught_up, (unsigned)stats.ticks_lost);
+    request->send(200, "application/json", out_json);
+  });
+
+  server.on("/patterns.json", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send_P(200, "application/json", patterns_json);
+  });
+
+  server.on("/special_colors.json", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send_P(200, "application/json", special_colors_json);
+  });
+}